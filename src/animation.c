@@ -0,0 +1,311 @@
+/** @file Event triggered animations and the timer wheel used to expire them
+ * @author Hunter Whyte
+*/
+#include "animation.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "skin.h"
+
+// =============== TIMER WHEEL ===============
+
+static void wheel_init(skin_timer_wheel_t* wheel) {
+  wheel->now = 0;
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    wheel->occupied[level] = 0;
+    for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      wheel->slots[level][slot] = -1;
+    }
+  }
+  // thread all timers onto the free list
+  for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+    wheel->timers[i].next = i + 1;
+  }
+  wheel->timers[TIMER_POOL_SIZE - 1].next = -1;
+  wheel->free_timers = 0;
+}
+
+/**
+ * @brief place a timer in the slot matching how far away its expiry is, timers close to expiring
+ * go in the lowest level and get moved down a level every time the level below wraps around
+*/
+static void wheel_insert(skin_timer_wheel_t* wheel, int timer) {
+  skin_timer_t* t = &wheel->timers[timer];
+  uint64_t delta = t->expiry - wheel->now;
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << ((level + 1) * TIMER_WHEEL_BITS))) {
+    level++;
+  }
+  int slot = (t->expiry >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+  t->next = wheel->slots[level][slot];
+  wheel->slots[level][slot] = timer;
+  wheel->occupied[level] |= 1ull << slot;
+}
+
+/**
+ * @brief take every timer out of a slot, returns the first of them
+*/
+static int wheel_take(skin_timer_wheel_t* wheel, int level, int slot) {
+  int timer = wheel->slots[level][slot];
+  wheel->slots[level][slot] = -1;
+  wheel->occupied[level] &= ~(1ull << slot);
+  return timer;
+}
+
+static void wheel_cascade(skin_timer_wheel_t* wheel, int level, int slot) {
+  int timer = wheel_take(wheel, level, slot);
+  while (timer != -1) {
+    int next = wheel->timers[timer].next;
+    wheel_insert(wheel, timer);
+    timer = next;
+  }
+}
+
+static void animation_expire(skin_t* skin, int index);
+
+/**
+ * @brief the first tick after now that has work to do, either a level 0 slot with timers in it
+ * or the tick an occupied slot of a higher level gets cascaded down. UINT64_MAX if the wheel is
+ * empty.
+*/
+static uint64_t wheel_next_tick(const skin_timer_wheel_t* wheel) {
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    uint64_t mask = wheel->occupied[level];
+    if (mask == 0) {
+      continue;
+    }
+    // slots of this level come round once every 1 << shift ticks, find how many turns it is to
+    // the first occupied one after the current
+    int shift = level * TIMER_WHEEL_BITS;
+    uint64_t base = wheel->now >> shift;
+    int start = (int)((base + 1) & TIMER_WHEEL_MASK);
+    uint64_t rotated = start == 0 ? mask : (mask >> start) | (mask << (TIMER_WHEEL_SLOTS - start));
+    uint64_t tick = (base + 1 + __builtin_ctzll(rotated)) << shift;
+    next = MIN(next, tick);
+  }
+  return next;
+}
+
+/**
+ * @brief process every tick up to and including target, firing timers as they expire. Ticks with
+ * nothing to do are jumped over, so a long frame costs no more than the timers it fires.
+*/
+static void wheel_advance(skin_t* skin, uint64_t target) {
+  skin_timer_wheel_t* wheel = &skin->timer_wheel;
+
+  // no instances running means no timers are pending, so there is nothing to walk over
+  if (skin->num_active_animations == 0) {
+    wheel->now = MAX(wheel->now, target);
+    return;
+  }
+
+  while (wheel->now < target) {
+    uint64_t next = wheel_next_tick(wheel);
+    if (next > target) {
+      wheel->now = target;
+      return;
+    }
+    wheel->now = next;
+
+    // every time a level wraps around pull down the next slot of the level above
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      if ((wheel->now & ((1ull << (level * TIMER_WHEEL_BITS)) - 1)) != 0) {
+        break;
+      }
+      wheel_cascade(wheel, level, (wheel->now >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+    }
+
+    int timer = wheel_take(wheel, 0, wheel->now & TIMER_WHEEL_MASK);
+    while (timer != -1) {
+      skin_timer_t* t = &wheel->timers[timer];
+      int next_timer = t->next;
+      animation_expire(skin, t->animation);
+      t->next = wheel->free_timers;
+      wheel->free_timers = timer;
+      timer = next_timer;
+    }
+  }
+}
+
+// =============== ANIMATIONS ===============
+
+void animation_init(skin_t* skin) {
+  skin->time = 0;
+  skin->num_events = 0;
+  skin->num_animations = 0;
+  skin->num_active_animations = 0;
+  wheel_init(&skin->timer_wheel);
+}
+
+static void animation_activate(skin_t* skin, int index) {
+  skin_animation_t* anim = &skin->animations[index];
+  anim->active_index = skin->num_active_animations;
+  skin->active_animations[skin->num_active_animations] = index;
+  skin->num_active_animations++;
+}
+
+static void animation_deactivate(skin_t* skin, int index) {
+  skin_animation_t* anim = &skin->animations[index];
+  // swap remove from the active list
+  int last = skin->active_animations[skin->num_active_animations - 1];
+  skin->active_animations[anim->active_index] = last;
+  skin->animations[last].active_index = anim->active_index;
+  skin->num_active_animations--;
+  anim->active_index = -1;
+}
+
+/**
+ * @brief called when the oldest instance of an animation runs out
+*/
+static void animation_expire(skin_t* skin, int index) {
+  skin_animation_t* anim = &skin->animations[index];
+  assert(anim->num_instances > 0);
+  anim->head = (anim->head + 1) % MAX_ANIMATION_INSTANCES;
+  anim->num_instances--;
+  if (anim->num_instances == 0) {
+    anim->node->num_values = 0;
+    animation_deactivate(skin, index);
+  }
+}
+
+static void animation_start(skin_t* skin, int index) {
+  skin_animation_t* anim = &skin->animations[index];
+  skin_timer_wheel_t* wheel = &skin->timer_wheel;
+
+  if (anim->num_instances >= MAX_ANIMATION_INSTANCES) {
+    printf("warning animation %s exceeded max number of instances\n", anim->node->name);
+    return;
+  }
+  int timer = wheel->free_timers;
+  if (timer == -1) {
+    printf("warning animation timer pool exhausted\n");
+    return;
+  }
+  wheel->free_timers = wheel->timers[timer].next;
+
+  // clamped as a double, lengths past the range of the wheel don't fit in an integer either
+  double max_ticks = (double)((1u << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1);
+  uint64_t ticks = (uint64_t)MIN(MAX(ceil(anim->length / TIMER_TICK), 1.0), max_ticks);
+  wheel->timers[timer].expiry = wheel->now + ticks;
+  wheel->timers[timer].animation = index;
+  wheel_insert(wheel, timer);
+
+  anim->start[(anim->head + anim->num_instances) % MAX_ANIMATION_INSTANCES] = skin->time;
+  anim->num_instances++;
+  anim->node->values[anim->num_instances - 1] = 0.0f;
+  anim->node->num_values = anim->num_instances;
+
+  if (anim->active_index == -1) {
+    animation_activate(skin, index);
+  }
+}
+
+/**
+ * @brief advance skin time, expire finished instances and write out the progress of the ones
+ * still running. Only animations that have running instances are visited.
+*/
+void animation_update(skin_t* skin, float delta) {
+  skin->time += delta;
+  wheel_advance(skin, (uint64_t)MAX(skin->time / TIMER_TICK, 0.0));
+
+  for (int i = 0; i < skin->num_active_animations; i++) {
+    skin_animation_t* anim = &skin->animations[skin->active_animations[i]];
+    float* values = anim->node->values;
+    double time = skin->time;
+    double inv_length = 1.0 / anim->length;
+
+    // the ring buffer is at most two contiguous runs, do each as its own loop
+    int first = MIN(anim->num_instances, MAX_ANIMATION_INSTANCES - anim->head);
+    const double* start = &anim->start[anim->head];
+    for (int j = 0; j < first; j++) {
+      values[j] = (float)((time - start[j]) * inv_length);
+    }
+    start = anim->start;
+    for (int j = first; j < anim->num_instances; j++) {
+      values[j] = (float)((time - start[j - first]) * inv_length);
+    }
+    for (int j = 0; j < anim->num_instances; j++) {
+      values[j] = MIN(values[j], 1.0f);
+    }
+    anim->node->num_values = anim->num_instances;
+  }
+}
+
+// =============== EVENTS ===============
+
+int skin_find_event(skin_t* skin, const char* name) {
+  for (int i = 0; i < skin->num_events; i++) {
+    if (strcmp(skin->events[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void skin_trigger_event(skin_t* skin, int event) {
+  if (event < 0 || event >= skin->num_events) {
+    return;
+  }
+  for (int i = skin->events[event].first_animation; i != -1;
+       i = skin->animations[i].next_on_event) {
+    animation_start(skin, i);
+  }
+  for (int i = skin->events[event].first_emitter; i != -1; i = skin->emitters[i].next_on_event) {
+    skin->emitters[i].pending_bursts++;
+  }
+}
+
+/**
+ * @brief index of the event called name, created if it does not exist yet. -1 if there is no room
+*/
+int skin_add_event(skin_t* skin, const char* name) {
+  int event = skin_find_event(skin, name);
+  if (event != -1) {
+    return event;
+  }
+  if (skin->num_events >= MAX_EVENTS) {
+    printf("ERROR: exceeded max number of events\n");
+    return -1;
+  }
+  event = skin->num_events++;
+  snprintf(skin->events[event].name, MAX_NAME_LENGTH, "%s", name);
+  skin->events[event].first_animation = -1;
+  skin->events[event].first_emitter = -1;
+  return event;
+}
+
+/**
+ * @brief create an animation node named name that gets a new instance every time event fires
+*/
+skin_animation_t* skin_add_animation(skin_t* skin, const char* name, float length,
+                                     const char* event) {
+  if (skin->num_animations >= MAX_ANIMATIONS) {
+    printf("ERROR: exceeded max number of animations\n");
+    return NULL;
+  }
+  if (length <= 0) {
+    printf("ERROR: animation %s must have a positive length\n", name);
+    return NULL;
+  }
+
+  int event_index = skin_add_event(skin, event);
+  if (event_index == -1) {
+    return NULL;
+  }
+
+  int index = skin->num_animations++;
+  skin_animation_t* anim = &skin->animations[index];
+  anim->node = node_alloc(skin);
+  snprintf(anim->node->name, MAX_NAME_LENGTH, "%s", name);
+  anim->length = length;
+  anim->head = 0;
+  anim->num_instances = 0;
+  anim->active_index = -1;
+  anim->next_on_event = skin->events[event_index].first_animation;
+  skin->events[event_index].first_animation = index;
+  return anim;
+}
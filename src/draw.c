@@ -0,0 +1,487 @@
+/** @file Expanding item field arrays into instance records for the renderer
+ * @author Hunter Whyte
+*/
+#include "draw.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "skin.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// items draw their whole texture until they get a source rectangle of their own
+static const float full_texture[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+
+static const float field_defaults[NUM_SKINFIELDS] = {
+    [SKINFIELD_R] = 1.0f,
+    [SKINFIELD_G] = 1.0f,
+    [SKINFIELD_B] = 1.0f,
+    [SKINFIELD_A] = 1.0f,
+};
+
+/**
+ * @brief count contiguous values of field f following the indexer rules, pointing straight at the
+ * evaluated values whenever they are already laid out that way
+*/
+static const float* field_expand(const skin_item_t* item, draw_scratch_t* scratch, int f,
+                                 int count) {
+  const float* values = item->values[f];
+  int len = item->num_values[f];
+  int stride = item->strides[f] > 1 ? item->strides[f] : 1;
+  if (stride == 1 && len >= count) {
+    return values;
+  }
+
+  float* out = scratch->fields[f];
+  float fill = item->fields[f] == NULL ? field_defaults[f] : 0.0f;
+  if (len > 0) {
+    int num_copy = MIN(len, count);
+    for (int i = 0; i < num_copy; i++) {
+      out[i] = values[i * stride];
+    }
+    fill = values[(len - 1) * stride];
+  }
+  for (int i = MIN(len, count); i < count; i++) {
+    out[i] = fill;
+  }
+  return out;
+}
+
+static inline uint32_t pack_channel(float c) {
+  return (uint32_t)(MIN(MAX(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+#ifdef __SSE2__
+// pack_channel for 4 values at once
+static inline __m128i channel_bytes(const float* c) {
+  __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(c), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+#endif
+
+int draw_emit_item(const skin_item_t* item, draw_scratch_t* scratch, draw_instance_t* out,
+                   int max_instances) {
+  int count = MIN(item->num_values[SKINFIELD_X], max_instances);
+  if (count <= 0) {
+    return 0;
+  }
+  const float* x = field_expand(item, scratch, SKINFIELD_X, count);
+  const float* y = field_expand(item, scratch, SKINFIELD_Y, count);
+  const float* w = field_expand(item, scratch, SKINFIELD_W, count);
+  const float* h = field_expand(item, scratch, SKINFIELD_H, count);
+  const float* r = field_expand(item, scratch, SKINFIELD_R, count);
+  const float* g = field_expand(item, scratch, SKINFIELD_G, count);
+  const float* b = field_expand(item, scratch, SKINFIELD_B, count);
+  const float* a = field_expand(item, scratch, SKINFIELD_A, count);
+
+  int i = 0;
+#ifdef __SSE2__
+  // transpose 4 instances at a time, each row of x, y, w, h becomes the first 16 bytes of a record
+  const __m128 uv = _mm_loadu_ps(full_texture);
+  for (; i + 4 <= count; i += 4) {
+    __m128 row0 = _mm_loadu_ps(&x[i]);
+    __m128 row1 = _mm_loadu_ps(&y[i]);
+    __m128 row2 = _mm_loadu_ps(&w[i]);
+    __m128 row3 = _mm_loadu_ps(&h[i]);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+    __m128i ri = channel_bytes(&r[i]);
+    __m128i gi = channel_bytes(&g[i]);
+    __m128i bi = channel_bytes(&b[i]);
+    __m128i ai = channel_bytes(&a[i]);
+    __m128i rgba = _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)),
+                                _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_slli_epi32(ai, 24)));
+    uint32_t packed[4];
+    _mm_storeu_si128((__m128i*)packed, rgba);
+
+    _mm_storeu_ps(&out[i + 0].x, row0);
+    _mm_storeu_ps(&out[i + 1].x, row1);
+    _mm_storeu_ps(&out[i + 2].x, row2);
+    _mm_storeu_ps(&out[i + 3].x, row3);
+    for (int j = 0; j < 4; j++) {
+      _mm_storeu_ps(&out[i + j].u, uv);
+      out[i + j].rgba = packed[j];
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    out[i].x = x[i];
+    out[i].y = y[i];
+    out[i].w = w[i];
+    out[i].h = h[i];
+    memcpy(&out[i].u, full_texture, sizeof(full_texture));
+    out[i].rgba = pack_channel(r[i]) | pack_channel(g[i]) << 8 | pack_channel(b[i]) << 16 |
+                  pack_channel(a[i]) << 24;
+  }
+  return count;
+}
+
+// =============== VERTICES ===============
+
+// how far along w and h each corner is, in the order of draw_expand_quads
+static const float corner_offsets[4][2] = {{0, 0}, {0, 1}, {1, 1}, {1, 0}};
+
+static inline uint16_t pack_unorm16(float c) {
+  return (uint16_t)(MIN(MAX(c, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+void draw_expand_quads(draw_vertex_t* out, const draw_instance_t* instances, int num_instances) {
+  int i = 0;
+#ifdef __SSE2__
+  // load 4 instances as columns, build each corner for all 4 at once and transpose it back out
+  // into 4 vertices
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(65535.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  for (; i + 4 <= num_instances; i += 4) {
+    const draw_instance_t* d = &instances[i];
+    __m128 x = _mm_loadu_ps(&d[0].x);
+    __m128 y = _mm_loadu_ps(&d[1].x);
+    __m128 w = _mm_loadu_ps(&d[2].x);
+    __m128 h = _mm_loadu_ps(&d[3].x);
+    _MM_TRANSPOSE4_PS(x, y, w, h);
+    __m128 u = _mm_loadu_ps(&d[0].u);
+    __m128 v = _mm_loadu_ps(&d[1].u);
+    __m128 src_w = _mm_loadu_ps(&d[2].u);
+    __m128 src_h = _mm_loadu_ps(&d[3].u);
+    _MM_TRANSPOSE4_PS(u, v, src_w, src_h);
+    __m128 rgba = _mm_castsi128_ps(_mm_set_epi32(d[3].rgba, d[2].rgba, d[1].rgba, d[0].rgba));
+
+    for (int k = 0; k < 4; k++) {
+      __m128 ox = _mm_set1_ps(corner_offsets[k][0]);
+      __m128 oy = _mm_set1_ps(corner_offsets[k][1]);
+      __m128 px = _mm_add_ps(x, _mm_mul_ps(w, ox));
+      __m128 py = _mm_add_ps(y, _mm_mul_ps(h, oy));
+      __m128 cu = _mm_min_ps(_mm_max_ps(_mm_add_ps(u, _mm_mul_ps(src_w, ox)), zero), one);
+      __m128 cv = _mm_min_ps(_mm_max_ps(_mm_add_ps(v, _mm_mul_ps(src_h, oy)), zero), one);
+      __m128i iu = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cu, scale), half));
+      __m128i iv = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cv, scale), half));
+      __m128 uv = _mm_castsi128_ps(_mm_or_si128(iu, _mm_slli_epi32(iv, 16)));
+
+      __m128 c0 = px;
+      __m128 c1 = py;
+      __m128 c2 = uv;
+      __m128 c3 = rgba;
+      _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+      _mm_storeu_ps((float*)&out[(i + 0) * 4 + k], c0);
+      _mm_storeu_ps((float*)&out[(i + 1) * 4 + k], c1);
+      _mm_storeu_ps((float*)&out[(i + 2) * 4 + k], c2);
+      _mm_storeu_ps((float*)&out[(i + 3) * 4 + k], c3);
+    }
+  }
+#endif
+  for (; i < num_instances; i++) {
+    const draw_instance_t* d = &instances[i];
+    for (int k = 0; k < 4; k++) {
+      draw_vertex_t* vertex = &out[i * 4 + k];
+      vertex->x = d->x + d->w * corner_offsets[k][0];
+      vertex->y = d->y + d->h * corner_offsets[k][1];
+      vertex->u = pack_unorm16(d->u + d->src_w * corner_offsets[k][0]);
+      vertex->v = pack_unorm16(d->v + d->src_h * corner_offsets[k][1]);
+      vertex->rgba = d->rgba;
+    }
+  }
+}
+
+// =============== NUMBERS ===============
+
+#define NUMBER_MAX_PRECISION 6
+#define NUMBER_MAX_PAD 20
+// the largest fixed point value written out, keeps every digit exact in 64 bits
+#define NUMBER_MAX_FIXED 1e18
+
+static const double powers_of_ten[NUMBER_MAX_PRECISION + 1] = {1e0, 1e1, 1e2, 1e3,
+                                                               1e4, 1e5, 1e6};
+
+int draw_number_glyphs(float value, const skin_number_format_t* format, uint8_t* glyphs) {
+  int precision = MIN(MAX(format->precision, 0), NUMBER_MAX_PRECISION);
+  int pad = MIN(MAX(format->pad, 1), NUMBER_MAX_PAD);
+
+  // round once to a fixed point integer, every digit after that is exact
+  double magnitude = isnan(value) ? 0.0 : fabs((double)value);
+  double scaled = MIN(magnitude * powers_of_ten[precision] + 0.5, NUMBER_MAX_FIXED - 1);
+  uint64_t fixed = (uint64_t)scaled;
+  bool negative = value < 0 && fixed != 0;
+
+  // digits come out least significant first and get reversed at the end
+  uint8_t reversed[DRAW_NUMBER_MAX_GLYPHS];
+  int n = 0;
+  for (int i = 0; i < precision; i++) {
+    reversed[n++] = DRAW_GLYPH('0') + (uint8_t)(fixed % 10);
+    fixed /= 10;
+  }
+  if (precision > 0) {
+    reversed[n++] = DRAW_GLYPH('.');
+  }
+  int digits = 0;
+  do {
+    if (format->separators && digits > 0 && digits % 3 == 0) {
+      reversed[n++] = DRAW_GLYPH(',');
+    }
+    reversed[n++] = DRAW_GLYPH('0') + (uint8_t)(fixed % 10);
+    fixed /= 10;
+    digits++;
+  } while (fixed > 0 || digits < pad);
+  if (negative) {
+    reversed[n++] = DRAW_GLYPH('-');
+  }
+
+  for (int i = 0; i < n; i++) {
+    glyphs[i] = reversed[n - 1 - i];
+  }
+  return n;
+}
+
+// =============== COMMAND LIST ===============
+
+void draw_init(skin_t* skin) {
+  skin->draw_list = malloc(sizeof(draw_list_t));
+  draw_list_clear(skin->draw_list);
+  skin->draw_scratch = malloc(sizeof(draw_scratch_t));
+  skin->backend.execute = NULL;
+  skin->backend.user = NULL;
+}
+
+void draw_deinit(skin_t* skin) {
+  free(skin->draw_list);
+  free(skin->draw_scratch);
+}
+
+void draw_list_clear(draw_list_t* list) {
+  list->num_commands = 0;
+  list->num_instances = 0;
+  list->num_points = 0;
+  list->num_chars = 0;
+  list->num_glyphs = 0;
+  list->overflowed = false;
+}
+
+/**
+ * @brief append a command, NULL when the list is full
+*/
+static draw_command_t* list_push(draw_list_t* list, draw_command_type type, uint32_t handle) {
+  if (list->num_commands >= MAX_DRAW_COMMANDS) {
+    list->overflowed = true;
+    return NULL;
+  }
+  draw_command_t* cmd = &list->commands[list->num_commands++];
+  memset(cmd, 0, sizeof(draw_command_t));
+  cmd->type = type;
+  cmd->handle = handle;
+  return cmd;
+}
+
+void draw_list_primitive(draw_list_t* list, draw_primitive_type kind, const float* points,
+                         int num_points, uint32_t rgba) {
+  if (list->num_points + num_points > MAX_DRAW_POINTS) {
+    list->overflowed = true;
+    return;
+  }
+  draw_command_t* cmd = list_push(list, DRAWCMD_PRIMITIVE, kind);
+  if (cmd == NULL) {
+    return;
+  }
+  cmd->first = list->num_points;
+  cmd->count = num_points;
+  cmd->rgba = rgba;
+  memcpy(&list->points[list->num_points * 2], points, sizeof(float) * 2 * num_points);
+  list->num_points += num_points;
+}
+
+void draw_list_text(draw_list_t* list, uint32_t font, const char* text, float line_height,
+                    float x, float y, uint32_t rgba) {
+  int len = strlen(text);
+  if (list->num_chars + len > MAX_DRAW_CHARS) {
+    list->overflowed = true;
+    return;
+  }
+  draw_command_t* cmd = list_push(list, DRAWCMD_TEXT, font);
+  if (cmd == NULL) {
+    return;
+  }
+  cmd->first = list->num_chars;
+  cmd->count = len;
+  cmd->x = x;
+  cmd->y = y;
+  cmd->line_height = line_height;
+  cmd->rgba = rgba;
+  memcpy(&list->chars[list->num_chars], text, len);
+  list->num_chars += len;
+}
+
+static void list_quads(draw_list_t* list, draw_scratch_t* scratch, const skin_item_t* item) {
+  int room = MAX_DRAW_INSTANCES - list->num_instances;
+  int count = draw_emit_item(item, scratch, &list->instances[list->num_instances], room);
+  if (count < item->num_values[SKINFIELD_X]) {
+    list->overflowed = true;
+  }
+  if (count == 0) {
+    return;
+  }
+  // items that follow each other with the same texture share one command
+  draw_command_t* last = list->num_commands > 0 ? &list->commands[list->num_commands - 1] : NULL;
+  if (last != NULL && last->type == DRAWCMD_QUADS &&
+      last->first + last->count == list->num_instances) {
+    last->count += count;
+    list->num_instances += count;
+    return;
+  }
+  draw_command_t* cmd = list_push(list, DRAWCMD_QUADS, 0);
+  if (cmd == NULL) {
+    return;
+  }
+  cmd->first = list->num_instances;
+  cmd->count = count;
+  list->num_instances += count;
+}
+
+static void list_numbers(draw_list_t* list, draw_scratch_t* scratch, const skin_item_t* item) {
+  int count = draw_emit_item(item, scratch, scratch->numbers, MAX_VALUES);
+  const float* values = field_expand(item, scratch, SKINFIELD_VALUE, count);
+  for (int i = 0; i < count; i++) {
+    if (list->num_glyphs + DRAW_NUMBER_MAX_GLYPHS > MAX_DRAW_GLYPHS) {
+      list->overflowed = true;
+      return;
+    }
+    const draw_instance_t* instance = &scratch->numbers[i];
+    draw_command_t* cmd = list_push(list, DRAWCMD_GLYPHS, item->font);
+    if (cmd == NULL) {
+      return;
+    }
+    cmd->first = list->num_glyphs;
+    cmd->count = draw_number_glyphs(values[i], &item->format, &list->glyphs[list->num_glyphs]);
+    cmd->x = instance->x;
+    cmd->y = instance->y;
+    cmd->line_height = instance->h;
+    cmd->rgba = instance->rgba;
+    list->num_glyphs += cmd->count;
+  }
+}
+
+// =============== SORTING ===============
+
+// sort key bits, most significant first: layer, the full 32 bit texture handle, blend and the
+// item's place in its layer. The shader is set per layer so the layer bits already group by it.
+// Layers that keep their order leave the state bits at 0 so their items only sort by the order
+// they were added in
+#define KEY_LAYER_SHIFT 56
+#define KEY_TEXTURE_SHIFT 24
+#define KEY_BLEND_SHIFT 20
+
+static uint64_t draw_key(int layer_index, const skin_layer_t* layer, const skin_item_t* item,
+                         int sequence) {
+  uint64_t key = (uint64_t)layer_index << KEY_LAYER_SHIFT | (uint64_t)sequence;
+  if (layer->sort_items) {
+    key |= (uint64_t)(uint32_t)item->texture << KEY_TEXTURE_SHIFT;
+    key |= (uint64_t)(item->blend & 0xf) << KEY_BLEND_SHIFT;
+  }
+  return key;
+}
+
+/**
+ * @brief stable lsd radix sort on the key a byte at a time, bytes that are the same for every key
+ * are skipped. Returns whichever of the two arrays holds the result.
+*/
+static draw_entry_t* radix_sort(draw_entry_t* entries, draw_entry_t* scratch, int n) {
+  for (int shift = 0; shift < 64; shift += 8) {
+    int counts[256] = {0};
+    for (int i = 0; i < n; i++) {
+      counts[(entries[i].key >> shift) & 0xff]++;
+    }
+    if (counts[(entries[0].key >> shift) & 0xff] == n) {
+      continue;
+    }
+    int offset = 0;
+    for (int d = 0; d < 256; d++) {
+      int count = counts[d];
+      counts[d] = offset;
+      offset += count;
+    }
+    for (int i = 0; i < n; i++) {
+      scratch[counts[(entries[i].key >> shift) & 0xff]++] = entries[i];
+    }
+    draw_entry_t* swap = entries;
+    entries = scratch;
+    scratch = swap;
+  }
+  return entries;
+}
+
+void draw_build(skin_t* skin, draw_list_t* list) {
+  draw_list_clear(list);
+  draw_scratch_t* scratch = skin->draw_scratch;
+  draw_entry_t* entries = scratch->entries[0];
+  int n = 0;
+  for (int l = 0; l < skin->num_layers; l++) {
+    skin_layer_t* layer = &skin->layers[l];
+    for (int i = 0; i < layer->num_items; i++) {
+      const skin_item_t* item = &skin->items[layer->items[i]];
+      if (item->num_values[SKINFIELD_X] == 0) {
+        continue;
+      }
+      entries[n].key = draw_key(l, layer, item, i);
+      entries[n].item = layer->items[i];
+      n++;
+    }
+  }
+  if (n == 0) {
+    return;
+  }
+  const draw_entry_t* sorted = radix_sort(entries, scratch->entries[1], n);
+
+  // only set what differs from the state left by the previous item
+  int layer_index = -1;
+  unsigned shader = 0;
+  bool have_texture = false;
+  unsigned texture = 0;
+  skin_blend blend = SKINBLEND_ALPHA;
+  for (int e = 0; e < n; e++) {
+    const skin_item_t* item = &skin->items[sorted[e].item];
+    int l = (int)(sorted[e].key >> KEY_LAYER_SHIFT);
+    if (l != layer_index) {
+      layer_index = l;
+      list_push(list, DRAWCMD_SET_LAYER, l);
+      unsigned layer_shader = skin->layers[l].shader;
+      if (layer_shader != 0 && layer_shader != shader) {
+        list_push(list, DRAWCMD_SET_SHADER, layer_shader);
+        shader = layer_shader;
+      }
+    }
+    // glyphs bring their own texture, the one set for quads is left alone
+    if (!item->number && (!have_texture || item->texture != texture)) {
+      list_push(list, DRAWCMD_SET_TEXTURE, item->texture);
+      texture = item->texture;
+      have_texture = true;
+    }
+    if (item->blend != blend) {
+      list_push(list, DRAWCMD_SET_BLEND, item->blend);
+      blend = item->blend;
+    }
+    if (item->number) {
+      list_numbers(list, scratch, item);
+    } else {
+      list_quads(list, scratch, item);
+    }
+  }
+  if (list->overflowed) {
+    printf("warning draw list full, some of the frame was not drawn\n");
+  }
+}
+
+// =============== RECORDER ===============
+
+void draw_record(void* recorder, const draw_list_t* list) {
+  draw_recorder_t* r = (draw_recorder_t*)recorder;
+  r->frames++;
+  for (int i = 0; i < list->num_commands; i++) {
+    r->commands[list->commands[i].type]++;
+  }
+  r->instances += list->num_instances;
+  r->last = list;
+}
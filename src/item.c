@@ -0,0 +1,319 @@
+/** @file Layers and items, evaluating item fields into the arrays that get drawn
+ * @author Hunter Whyte
+*/
+#include "item.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "expression.h"
+#include "fastmath.h"
+#include "skin.h"
+
+void item_init(skin_t* skin) {
+  skin->num_items = 0;
+  skin->num_layers = 0;
+  skin->fixed_tick = false;
+  skin->frame_budget = 0;
+}
+
+void item_deinit(skin_t* skin) {
+  for (int i = 0; i < skin->num_items; i++) {
+    free(skin->items[i].tick_buffer);
+  }
+}
+
+/**
+ * @brief allocate the previous, current and output buffers of every field for fixed tick mode
+*/
+static void item_alloc_tick_buffers(skin_item_t* item) {
+  if (item->tick_buffer != NULL) {
+    return;
+  }
+  item->tick_buffer = malloc(sizeof(float) * MAX_VALUES * NUM_SKINFIELDS * 3);
+  for (int f = 0; f < NUM_SKINFIELDS; f++) {
+    item->prev[f] = &item->tick_buffer[MAX_VALUES * (f * 3 + 0)];
+    item->cur[f] = &item->tick_buffer[MAX_VALUES * (f * 3 + 1)];
+    item->out[f] = &item->tick_buffer[MAX_VALUES * (f * 3 + 2)];
+    item->prev_len[f] = 0;
+    item->cur_len[f] = 0;
+  }
+}
+
+void skin_set_fixed_tick(skin_t* skin, bool enabled) {
+  skin->fixed_tick = enabled;
+  if (enabled) {
+    for (int i = 0; i < skin->num_items; i++) {
+      item_alloc_tick_buffers(&skin->items[i]);
+    }
+  }
+}
+
+void skin_set_frame_budget(skin_t* skin, float seconds) {
+  skin->frame_budget = seconds;
+}
+
+skin_layer_t* skin_add_layer(skin_t* skin, const char* name) {
+  if (skin->num_layers >= MAX_LAYERS) {
+    printf("ERROR: exceeded max number of layers\n");
+    return NULL;
+  }
+  skin_layer_t* layer = &skin->layers[skin->num_layers++];
+  memset(layer, 0, sizeof(skin_layer_t));
+  snprintf(layer->name, MAX_NAME_LENGTH, "%s", name);
+  // so that a new layer is due on its first frame no matter its update settings
+  layer->frames_since_update = 1 << 20;
+  layer->last_update = -1e9;
+  return layer;
+}
+
+skin_item_t* skin_add_item(skin_t* skin, skin_layer_t* layer, const char* name) {
+  if (skin->num_items >= MAX_ITEMS || layer->num_items >= MAX_LAYER_ITEMS) {
+    printf("ERROR: exceeded max number of items\n");
+    return NULL;
+  }
+  int index = skin->num_items++;
+  skin_item_t* item = &skin->items[index];
+  memset(item, 0, sizeof(skin_item_t));
+  snprintf(item->name, MAX_NAME_LENGTH, "%s", name);
+  if (skin->fixed_tick) {
+    item_alloc_tick_buffers(item);
+  }
+  layer->items[layer->num_items++] = index;
+  return item;
+}
+
+/**
+ * @brief set the expression of a field. A vector expression sets that many fields starting at
+ * field, so a vec2 on SKINFIELD_X gives both x and y and a vec4 on SKINFIELD_R gives the colour.
+*/
+skin_error skin_item_set_field(skin_t* skin, skin_item_t* item, skin_field field,
+                               const char* expression) {
+  assert(field < NUM_SKINFIELDS);
+  skin_node_t* node = expression_parse(skin, expression);
+  if (node == NULL) {
+    return SKINERR_EXPRESSION_ERROR;
+  }
+  int width = node_width(node);
+  // the value field of number items is not part of the quad fields a vector can spread over
+  int end = field < SKINFIELD_VALUE ? SKINFIELD_VALUE : NUM_SKINFIELDS;
+  if ((int)field + width > end) {
+    printf("ERROR: item %s vector field runs past the last field\n", item->name);
+    return SKINERR_EXPRESSION_ERROR;
+  }
+  for (int c = 0; c < width; c++) {
+    // drop every field of a vector that was set over this one before
+    skin_node_t* old = item->fields[field + c];
+    for (int f = 0; old != NULL && node_width(old) > 1 && f < NUM_SKINFIELDS; f++) {
+      if (item->fields[f] == old) {
+        item->fields[f] = NULL;
+      }
+    }
+  }
+  for (int c = 0; c < width; c++) {
+    item->fields[field + c] = node;
+    item->components[field + c] = c;
+  }
+  return SKINERR_SUCCESS;
+}
+
+/**
+ * @brief turn item into a number item, drawn as the text of its value field
+*/
+void skin_item_set_number(skin_item_t* item, unsigned font, const skin_number_format_t* format) {
+  item->number = true;
+  item->font = font;
+  item->format = *format;
+}
+
+static void item_evaluate(skin_item_t* item) {
+  for (int f = 0; f < NUM_SKINFIELDS; f++) {
+    skin_node_t* node = item->fields[f];
+    if (node == NULL) {
+      item->values[f] = NULL;
+      item->num_values[f] = 0;
+      item->strides[f] = 1;
+      continue;
+    }
+    // the other components of a vector were already evaluated along with the first
+    int component = item->components[f];
+    if (component == 0) {
+      node_evaluate(node);
+    }
+    int width = node_width(node);
+    item->values[f] = &node->values[component];
+    item->num_values[f] = node->num_values / width;
+    item->strides[f] = width;
+  }
+}
+
+/**
+ * @brief keep a copy of the evaluated values as the current tick, the old current tick becomes the
+ * previous one. Throttled layers also use this outside of fixed tick mode so the values they draw
+ * stay put while the nodes they read from keep changing.
+*/
+static void item_store(skin_item_t* item) {
+  for (int f = 0; f < NUM_SKINFIELDS; f++) {
+    float* swap = item->prev[f];
+    item->prev[f] = item->cur[f];
+    item->prev_len[f] = item->cur_len[f];
+    item->cur[f] = swap;
+    item->cur_len[f] = item->num_values[f];
+    if (item->strides[f] == 1) {
+      if (item->num_values[f] > 0) {
+        memcpy(item->cur[f], item->values[f], sizeof(float) * item->num_values[f]);
+      }
+    } else {
+      for (int i = 0; i < item->num_values[f]; i++) {
+        item->cur[f][i] = item->values[f][i * item->strides[f]];
+      }
+    }
+  }
+}
+
+static double clock_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool layer_throttled(skin_layer_t* layer) {
+  return layer->update_every > 1 || layer->max_rate > 0 || layer->priority > 0;
+}
+
+static bool layer_due(skin_t* skin, skin_layer_t* layer) {
+  if (layer->frames_since_update + 1 < layer->update_every) {
+    return false;
+  }
+  if (layer->max_rate > 0 && skin->time - layer->last_update < 1.0 / layer->max_rate) {
+    return false;
+  }
+  return true;
+}
+
+static void layer_run(skin_t* skin, skin_layer_t* layer, bool tick) {
+  bool throttled = layer_throttled(layer);
+  for (int i = 0; i < layer->num_items; i++) {
+    skin_item_t* item = &skin->items[layer->items[i]];
+    item_evaluate(item);
+    if (tick) {
+      item_store(item);
+    } else if (throttled) {
+      item_alloc_tick_buffers(item);
+      item_store(item);
+      for (int f = 0; f < NUM_SKINFIELDS; f++) {
+        item->values[f] = item->cur[f];
+        item->strides[f] = 1;
+      }
+    }
+  }
+  layer->frames_since_update = 0;
+  layer->deferred_frames = 0;
+  layer->last_update = skin->time;
+}
+
+/**
+ * @brief leave the layer as it was last evaluated
+*/
+static void layer_hold(skin_t* skin, skin_layer_t* layer, bool tick) {
+  layer->frames_since_update++;
+  if (tick) {
+    // no previous tick means interpolation snaps to the current values
+    for (int i = 0; i < layer->num_items; i++) {
+      skin_item_t* item = &skin->items[layer->items[i]];
+      for (int f = 0; f < NUM_SKINFIELDS; f++) {
+        item->prev_len[f] = 0;
+      }
+    }
+  }
+}
+
+// order deferrable layers run in, lowest first
+static int layer_order(skin_layer_t* layer) {
+  return layer->priority - layer->deferred_frames;
+}
+
+/**
+ * @brief evaluate the layers that are due this frame. Priority 0 layers always run, the rest run
+ * afterwards in priority order for as long as the frame budget allows. Every frame a layer gets
+ * deferred moves it up the order, and after MAX_DEFERRED_FRAMES it runs regardless of budget.
+*/
+static void layers_schedule(skin_t* skin, bool tick) {
+  double start = clock_seconds();
+  int deferrable[MAX_LAYERS];
+  int num_deferrable = 0;
+
+  for (int i = 0; i < skin->num_layers; i++) {
+    skin_layer_t* layer = &skin->layers[i];
+    if (!layer_due(skin, layer)) {
+      layer_hold(skin, layer, tick);
+    } else if (layer->priority <= 0 || skin->frame_budget <= 0 ||
+               layer->deferred_frames >= MAX_DEFERRED_FRAMES) {
+      layer_run(skin, layer, tick);
+    } else {
+      deferrable[num_deferrable++] = i;
+    }
+  }
+
+  // insertion sort, there are only ever a handful of layers
+  for (int i = 1; i < num_deferrable; i++) {
+    int index = deferrable[i];
+    int key = layer_order(&skin->layers[index]);
+    int j = i - 1;
+    while (j >= 0 && layer_order(&skin->layers[deferrable[j]]) > key) {
+      deferrable[j + 1] = deferrable[j];
+      j--;
+    }
+    deferrable[j + 1] = index;
+  }
+
+  for (int i = 0; i < num_deferrable; i++) {
+    skin_layer_t* layer = &skin->layers[deferrable[i]];
+    if (clock_seconds() - start < skin->frame_budget) {
+      layer_run(skin, layer, tick);
+    } else {
+      layer->deferred_frames++;
+      layer_hold(skin, layer, tick);
+    }
+  }
+}
+
+/**
+ * @brief evaluate item fields for a new frame, the drawn values point straight at the node
+ * results unless the layer is throttled
+*/
+void items_evaluate(skin_t* skin) {
+  layers_schedule(skin, false);
+}
+
+/**
+ * @brief evaluate item fields for a new tick in fixed tick mode
+*/
+void items_tick(skin_t* skin) {
+  layers_schedule(skin, true);
+}
+
+/**
+ * @brief produce the drawn values alpha of the way between the previous and current tick.
+ * Elements that did not exist on the previous tick snap to their current value.
+*/
+void items_interpolate(skin_t* skin, float alpha) {
+  alpha = MIN(MAX(alpha, 0.0f), 1.0f);
+  for (int i = 0; i < skin->num_items; i++) {
+    skin_item_t* item = &skin->items[i];
+    for (int f = 0; f < NUM_SKINFIELDS; f++) {
+      int len = item->cur_len[f];
+      int num_lerp = MIN(len, item->prev_len[f]);
+      fast_lerp(item->out[f], item->prev[f], item->cur[f], alpha, num_lerp);
+      if (len > num_lerp) {
+        memcpy(&item->out[f][num_lerp], &item->cur[f][num_lerp], sizeof(float) * (len - num_lerp));
+      }
+      item->values[f] = item->out[f];
+      item->num_values[f] = len;
+      item->strides[f] = 1;
+    }
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "skin.h"
+
+void item_init(skin_t* skin);
+void item_deinit(skin_t* skin);
+void items_evaluate(skin_t* skin);
+void items_tick(skin_t* skin);
+void items_interpolate(skin_t* skin, float alpha);
+
+#ifdef __cplusplus
+}
+#endif
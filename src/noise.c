@@ -0,0 +1,79 @@
+/** @file Counter based random numbers and value noise
+ * @author Hunter Whyte
+*/
+#include "noise.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// 2^-24, turns the top 24 bits of a hash into a float in [0, 1)
+#define HASH_TO_UNIT 5.9604644775390625e-8f
+// 2^30, noise coordinates are clamped to this so the grid cell always fits in an int32. Floats
+// this large are whole numbers anyway, so the noise is flat out there
+#define NOISE_COORD_LIMIT 1073741824.0f
+
+/**
+ * @brief integer finalizer with good avalanche (every input bit flips about half of the output
+ * bits), only shifts, xors and multiplies so the loops using it vectorize
+*/
+static inline uint32_t hash1(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline uint32_t hash2(uint32_t a, uint32_t b) {
+  return hash1(b ^ hash1(a + 0x9e3779b9u));
+}
+
+static inline uint32_t float_bits(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+static inline float hash_to_unit(uint32_t h) {
+  return (float)(h >> 8) * HASH_TO_UNIT;
+}
+
+void noise_rand(float* out, const float* seed, const float* index, int len) {
+  for (int i = 0; i < len; i++) {
+    // adding +0 turns -0 into +0, values that compare equal have to hash the same
+    out[i] = hash_to_unit(hash2(float_bits(seed[i] + 0.0f), float_bits(index[i] + 0.0f)));
+  }
+}
+
+// written so that NaN fails both compares and ends up at the lower limit
+static inline float clamp_coord(float x) {
+  x = x >= -NOISE_COORD_LIMIT ? x : -NOISE_COORD_LIMIT;
+  return x <= NOISE_COORD_LIMIT ? x : NOISE_COORD_LIMIT;
+}
+
+static inline int32_t floor_int(float x) {
+  int32_t i = (int32_t)x;
+  return i - (x < (float)i);
+}
+
+void noise_value(float* out, const float* x_in, const float* y_in, int len) {
+  for (int i = 0; i < len; i++) {
+    float x = clamp_coord(x_in[i]);
+    float y = clamp_coord(y_in[i]);
+    int32_t xi = floor_int(x);
+    int32_t yi = floor_int(y);
+    float fx = x - (float)xi;
+    float fy = y - (float)yi;
+    float sx = fx * fx * (3.0f - 2.0f * fx);
+    float sy = fy * fy * (3.0f - 2.0f * fy);
+
+    float v00 = hash_to_unit(hash2((uint32_t)xi, (uint32_t)yi));
+    float v10 = hash_to_unit(hash2((uint32_t)xi + 1, (uint32_t)yi));
+    float v01 = hash_to_unit(hash2((uint32_t)xi, (uint32_t)yi + 1));
+    float v11 = hash_to_unit(hash2((uint32_t)xi + 1, (uint32_t)yi + 1));
+    float top = v00 + (v10 - v00) * sx;
+    float bottom = v01 + (v11 - v01) * sx;
+    out[i] = top + (bottom - top) * sy;
+  }
+}
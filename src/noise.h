@@ -0,0 +1,28 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stateless random numbers for effects. Every value is a hash of its inputs alone, there is no
+ * generator state, so the same inputs give the same values on every frame, every run and every
+ * machine, and any number of arrays can be generated at once without sharing anything.
+ */
+
+/**
+ * @brief out[i] = uniform value in [0, 1) picked by (seed[i], index[i]). Inputs are hashed by
+ * their bits, so any float works as a seed or index, not only whole numbers. -0 and +0 are the
+ * same value.
+ */
+void noise_rand(float* out, const float* seed, const float* index, int len);
+
+/**
+ * @brief out[i] = 2d value noise in [0, 1] at (x[i], y[i]). Random values on the integer grid are
+ * blended with a smoothstep, so the result is continuous and varies over roughly one unit.
+ * Coordinates are clamped to +-2^30 and NaN reads as the lower limit.
+ */
+void noise_value(float* out, const float* x, const float* y, int len);
+
+#ifdef __cplusplus
+}
+#endif
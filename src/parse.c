@@ -31,6 +31,23 @@ static const cyaml_schema_field_t vertex_fields_schema[] = {
     CYAML_FIELD_STRING_PTR("y", CYAML_FLAG_POINTER, vertex_t, y, 0, MAX_EXPRESSION_LENGTH),
     CYAML_FIELD_END};
 
+// items with a number are drawn as the text of its value instead of as textured quads
+typedef struct number {
+  char* value;
+  unsigned font;
+  int pad;
+  int precision;
+  bool separators;
+} number_t;
+static const cyaml_schema_field_t number_fields_schema[] = {
+    CYAML_FIELD_STRING_PTR("value", CYAML_FLAG_POINTER, number_t, value, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_UINT("font", CYAML_FLAG_OPTIONAL, number_t, font),
+    CYAML_FIELD_INT("pad", CYAML_FLAG_OPTIONAL, number_t, pad),
+    CYAML_FIELD_INT("precision", CYAML_FLAG_OPTIONAL, number_t, precision),
+    CYAML_FIELD_BOOL("separators", CYAML_FLAG_OPTIONAL, number_t, separators),
+    CYAML_FIELD_END};
+
 typedef struct item {
   char* name;
   char* x;
@@ -38,6 +55,7 @@ typedef struct item {
   char* w;
   char* h;
   texture_t texture;
+  number_t* number;
 } item_t;
 static const cyaml_schema_field_t item_fields_schema[] = {
     CYAML_FIELD_STRING_PTR("name", CYAML_FLAG_POINTER, item_t, name, 0, MAX_NAME_LENGTH),
@@ -46,6 +64,8 @@ static const cyaml_schema_field_t item_fields_schema[] = {
     CYAML_FIELD_STRING_PTR("w", CYAML_FLAG_POINTER, item_t, w, 0, MAX_EXPRESSION_LENGTH),
     CYAML_FIELD_STRING_PTR("h", CYAML_FLAG_POINTER, item_t, h, 0, MAX_EXPRESSION_LENGTH),
     CYAML_FIELD_MAPPING("texture", CYAML_FLAG_DEFAULT, item_t, texture, texture_fields_schema),
+    CYAML_FIELD_MAPPING_PTR("number", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, item_t, number,
+                            number_fields_schema),
     CYAML_FIELD_END};
 
 typedef struct shader {
@@ -81,23 +101,113 @@ static const cyaml_schema_field_t mask_fields_schema[] = {
     CYAML_FIELD_STRING_PTR("h", CYAML_FLAG_POINTER, mask_t, h, 0, MAX_EXPRESSION_LENGTH),
     CYAML_FIELD_END};
 
+static const cyaml_schema_value_t item_schema = {
+    CYAML_VALUE_MAPPING(CYAML_FLAG_DEFAULT, item_t, item_fields_schema),
+};
+
+// particle emitter, every setting but the name and the size of the particles is optional
+typedef struct emitter {
+  char* name;
+  char* event;
+  char* rate;
+  char* burst;
+  char* life;
+  char* x;
+  char* y;
+  char* vx;
+  char* vy;
+  char* ax;
+  char* ay;
+  char* r;
+  char* g;
+  char* b;
+  char* a;
+  char* w;
+  char* h;
+  texture_t texture;
+} emitter_t;
+static const cyaml_schema_field_t emitter_fields_schema[] = {
+    CYAML_FIELD_STRING_PTR("name", CYAML_FLAG_POINTER, emitter_t, name, 0, MAX_NAME_LENGTH),
+    CYAML_FIELD_STRING_PTR("event", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, event, 0,
+                           MAX_NAME_LENGTH),
+    CYAML_FIELD_STRING_PTR("rate", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, rate, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("burst", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, burst, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("life", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, life, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("x", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, x, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("y", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, y, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("vx", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, vx, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("vy", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, vy, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("ax", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, ax, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("ay", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, ay, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("r", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, r, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("g", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, g, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("b", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, b, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("a", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, emitter_t, a, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("w", CYAML_FLAG_POINTER, emitter_t, w, 0, MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("h", CYAML_FLAG_POINTER, emitter_t, h, 0, MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_MAPPING("texture", CYAML_FLAG_DEFAULT, emitter_t, texture, texture_fields_schema),
+    CYAML_FIELD_END};
+
+static const cyaml_schema_value_t emitter_schema = {
+    CYAML_VALUE_MAPPING(CYAML_FLAG_DEFAULT, emitter_t, emitter_fields_schema),
+};
+
 typedef struct layer {
   char* name;
-  skin_item_t items[MAX_ITEMS];
+  item_t* items;
   unsigned num_items;
-  skin_shader_t shader;
+  emitter_t* emitters;
+  unsigned num_emitters;
+  shader_t shader;
   offset_t offset;
   mask_t mask;
+  int update_every;
+  float max_rate;
+  int priority;
+  bool sort;
 } layer_t;
 static const cyaml_schema_field_t layer_fields_schema[] = {
     CYAML_FIELD_STRING_PTR("name", CYAML_FLAG_POINTER, layer_t, name, 0, MAX_NAME_LENGTH),
 
     CYAML_FIELD_SEQUENCE("items", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, layer_t, items,
-                         num_items, &item_fields_schema, 0, CYAML_UNLIMITED),
+                         num_items, &item_schema, 0, MAX_LAYER_ITEMS),
+
+    CYAML_FIELD_SEQUENCE("emitters", CYAML_FLAG_POINTER | CYAML_FLAG_OPTIONAL, layer_t, emitters,
+                         num_emitters, &emitter_schema, 0, MAX_EMITTERS),
 
     CYAML_FIELD_MAPPING("shader", CYAML_FLAG_DEFAULT, layer_t, shader, shader_fields_schema),
 
     CYAML_FIELD_MAPPING("offset", CYAML_FLAG_DEFAULT, layer_t, offset, offset_fields_schema),
 
     CYAML_FIELD_MAPPING("mask", CYAML_FLAG_DEFAULT, layer_t, mask, mask_fields_schema),
-    CYAML_FIELD_END};
\ No newline at end of file
+
+    CYAML_FIELD_INT("update_every", CYAML_FLAG_OPTIONAL, layer_t, update_every),
+    CYAML_FIELD_FLOAT("max_rate", CYAML_FLAG_OPTIONAL, layer_t, max_rate),
+    CYAML_FIELD_INT("priority", CYAML_FLAG_OPTIONAL, layer_t, priority),
+    CYAML_FIELD_BOOL("sort", CYAML_FLAG_OPTIONAL, layer_t, sort),
+    CYAML_FIELD_END};
+
+typedef struct animation {
+  char* name;
+  char* length;
+  char* event;
+} animation_t;
+static const cyaml_schema_field_t animation_fields_schema[] = {
+    CYAML_FIELD_STRING_PTR("name", CYAML_FLAG_POINTER, animation_t, name, 0, MAX_NAME_LENGTH),
+    CYAML_FIELD_STRING_PTR("length", CYAML_FLAG_POINTER, animation_t, length, 0,
+                           MAX_EXPRESSION_LENGTH),
+    CYAML_FIELD_STRING_PTR("event", CYAML_FLAG_POINTER, animation_t, event, 0, MAX_NAME_LENGTH),
+    CYAML_FIELD_END};
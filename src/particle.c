@@ -0,0 +1,276 @@
+/** @file Particle emitters, spawning, moving and removing particles kept as arrays of node values
+ * @author Hunter Whyte
+*/
+#include "particle.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "expression.h"
+#include "skin.h"
+
+// shortest lifetime a particle can have, keeps 1 / life finite
+#define MIN_PARTICLE_LIFE 0.000001f
+
+static const char* particle_names[NUM_SKINPARTICLE] = {
+    [SKINPARTICLE_X] = "x",   [SKINPARTICLE_Y] = "y", [SKINPARTICLE_VX] = "vx",
+    [SKINPARTICLE_VY] = "vy", [SKINPARTICLE_AGE] = "age", [SKINPARTICLE_R] = "r",
+    [SKINPARTICLE_G] = "g",   [SKINPARTICLE_B] = "b", [SKINPARTICLE_A] = "a",
+};
+
+// value a setting takes when it is not set or evaluates to nothing
+static const float setting_defaults[NUM_SKINEMIT] = {
+    [SKINEMIT_LIFE] = 1.0f, [SKINEMIT_R] = 1.0f, [SKINEMIT_G] = 1.0f,
+    [SKINEMIT_B] = 1.0f,    [SKINEMIT_A] = 1.0f,
+};
+
+void particle_init(skin_t* skin) {
+  skin->num_emitters = 0;
+}
+
+/**
+ * @brief create an emitter named name whose particles get drawn by a new item in layer. The item
+ * has its position and colour set to the particle arrays, its size is left for the skin to set.
+ * event can be NULL for an emitter that only spawns at its rate.
+*/
+skin_emitter_t* skin_add_emitter(skin_t* skin, skin_layer_t* layer, const char* name,
+                                 const char* event) {
+  if (skin->num_emitters >= MAX_EMITTERS) {
+    printf("ERROR: exceeded max number of emitters\n");
+    return NULL;
+  }
+  int event_index = -1;
+  if (event != NULL) {
+    event_index = skin_add_event(skin, event);
+    if (event_index == -1) {
+      return NULL;
+    }
+  }
+  skin_item_t* item = skin_add_item(skin, layer, name);
+  if (item == NULL) {
+    return NULL;
+  }
+
+  int index = skin->num_emitters++;
+  skin_emitter_t* emitter = &skin->emitters[index];
+  memset(emitter, 0, sizeof(skin_emitter_t));
+  snprintf(emitter->name, MAX_NAME_LENGTH, "%s", name);
+  for (int a = 0; a < NUM_SKINPARTICLE; a++) {
+    emitter->particles[a] = node_alloc(skin);
+    snprintf(emitter->particles[a]->name, MAX_NAME_LENGTH, "%s_%s", name, particle_names[a]);
+  }
+  emitter->spawn = node_alloc(skin);
+  snprintf(emitter->spawn->name, MAX_NAME_LENGTH, "%s_spawn", name);
+
+  emitter->item = item - skin->items;
+  item->fields[SKINFIELD_X] = emitter->particles[SKINPARTICLE_X];
+  item->fields[SKINFIELD_Y] = emitter->particles[SKINPARTICLE_Y];
+  item->fields[SKINFIELD_R] = emitter->particles[SKINPARTICLE_R];
+  item->fields[SKINFIELD_G] = emitter->particles[SKINPARTICLE_G];
+  item->fields[SKINFIELD_B] = emitter->particles[SKINPARTICLE_B];
+  item->fields[SKINFIELD_A] = emitter->particles[SKINPARTICLE_A];
+
+  emitter->next_on_event = -1;
+  if (event_index != -1) {
+    emitter->next_on_event = skin->events[event_index].first_emitter;
+    skin->events[event_index].first_emitter = index;
+  }
+  return emitter;
+}
+
+skin_error skin_emitter_set(skin_t* skin, skin_emitter_t* emitter, skin_emitter_setting setting,
+                            const char* expression) {
+  skin_node_t* node = expression_parse(skin, expression);
+  if (node == NULL) {
+    return SKINERR_EXPRESSION_ERROR;
+  }
+  if (node_width(node) > 1) {
+    printf("ERROR: emitter %s settings can not be vectors\n", emitter->name);
+    return SKINERR_EXPRESSION_ERROR;
+  }
+  emitter->settings[setting] = node;
+  return SKINERR_SUCCESS;
+}
+
+// =============== KERNELS ===============
+
+/**
+ * @brief semi implicit euler step of every particle, velocity first so a constant acceleration
+ * stays stable at any frame rate
+*/
+static void particles_integrate(skin_emitter_t* emitter, float ax, float ay, float delta) {
+  int n = emitter->num_particles;
+  float* x = emitter->particles[SKINPARTICLE_X]->values;
+  float* y = emitter->particles[SKINPARTICLE_Y]->values;
+  float* vx = emitter->particles[SKINPARTICLE_VX]->values;
+  float* vy = emitter->particles[SKINPARTICLE_VY]->values;
+  float* age = emitter->particles[SKINPARTICLE_AGE]->values;
+  const float* inv_life = emitter->inv_life;
+
+  for (int i = 0; i < n; i++) {
+    vx[i] += ax * delta;
+    x[i] += vx[i] * delta;
+  }
+  for (int i = 0; i < n; i++) {
+    vy[i] += ay * delta;
+    y[i] += vy[i] * delta;
+  }
+  for (int i = 0; i < n; i++) {
+    age[i] += inv_life[i] * delta;
+  }
+}
+
+/**
+ * @brief in fixed tick mode the item interpolates from the values it stored on the last tick by
+ * index, so a particle moved from slot from to slot to takes its stored values along. Fields that
+ * are not a particle array directly, or had nothing stored for the moved particle, snap from slot
+ * to onwards instead.
+*/
+static void tick_move(skin_item_t* item, const bool* direct, int to, int from) {
+  for (int f = 0; f < NUM_SKINFIELDS; f++) {
+    if (direct[f] && from < item->cur_len[f]) {
+      item->cur[f][to] = item->cur[f][from];
+    } else {
+      item->cur_len[f] = MIN(item->cur_len[f], to);
+    }
+  }
+}
+
+/**
+ * @brief remove every particle that has reached the end of its life by moving the last particle
+ * into its place. item is the emitter's item when its tick values need to follow the particles,
+ * NULL otherwise.
+*/
+static void particles_compact(skin_emitter_t* emitter, skin_item_t* item) {
+  bool direct[NUM_SKINFIELDS] = {false};
+  if (item != NULL) {
+    for (int f = 0; f < NUM_SKINFIELDS; f++) {
+      for (int a = 0; a < NUM_SKINPARTICLE; a++) {
+        direct[f] = direct[f] || item->fields[f] == emitter->particles[a];
+      }
+    }
+  }
+
+  const float* age = emitter->particles[SKINPARTICLE_AGE]->values;
+  int n = emitter->num_particles;
+  int i = 0;
+  while (i < n) {
+    if (age[i] < 1.0f) {
+      i++;
+      continue;
+    }
+    n--;
+    for (int a = 0; a < NUM_SKINPARTICLE; a++) {
+      float* values = emitter->particles[a]->values;
+      values[i] = values[n];
+    }
+    emitter->inv_life[i] = emitter->inv_life[n];
+    if (item != NULL) {
+      tick_move(item, direct, i, n);
+    }
+  }
+  emitter->num_particles = n;
+  for (int f = 0; f < NUM_SKINFIELDS; f++) {
+    if (direct[f]) {
+      item->cur_len[f] = MIN(item->cur_len[f], n);
+    }
+  }
+}
+
+// =============== SPAWNING ===============
+
+/**
+ * @brief evaluate a setting and return its first value
+*/
+static float setting_value(skin_emitter_t* emitter, skin_emitter_setting setting) {
+  skin_node_t* node = emitter->settings[setting];
+  if (node == NULL) {
+    return setting_defaults[setting];
+  }
+  node_evaluate(node);
+  return node->num_values > 0 ? node->values[0] : setting_defaults[setting];
+}
+
+/**
+ * @brief evaluate a setting into count values, the last value is extended
+*/
+static void setting_fill(skin_emitter_t* emitter, skin_emitter_setting setting, float* out,
+                         int count) {
+  skin_node_t* node = emitter->settings[setting];
+  int len = 0;
+  if (node != NULL) {
+    node_evaluate(node);
+    len = node->num_values;
+  }
+  if (len == 0) {
+    for (int i = 0; i < count; i++) {
+      out[i] = setting_defaults[setting];
+    }
+    return;
+  }
+  int num_copy = MIN(len, count);
+  memcpy(out, node->values, sizeof(float) * num_copy);
+  for (int i = num_copy; i < count; i++) {
+    out[i] = node->values[len - 1];
+  }
+}
+
+static void particles_spawn(skin_emitter_t* emitter, float delta) {
+  emitter->spawn_carry += MAX(setting_value(emitter, SKINEMIT_RATE), 0.0f) * delta;
+  int count = (int)emitter->spawn_carry;
+  emitter->spawn_carry -= count;
+  if (emitter->pending_bursts > 0) {
+    count += emitter->pending_bursts * (int)MAX(setting_value(emitter, SKINEMIT_BURST), 0.0f);
+    emitter->pending_bursts = 0;
+  }
+  // once the arrays are full new particles are dropped until old ones die
+  int first = emitter->num_particles;
+  count = MIN(count, MAX_VALUES - first);
+
+  float* ids = emitter->spawn->values;
+  for (int i = 0; i < count; i++) {
+    ids[i] = (float)(emitter->next_id + i);
+  }
+  emitter->spawn->num_values = count;
+  emitter->next_id += count;
+  if (count == 0) {
+    return;
+  }
+
+  float* life = &emitter->inv_life[first];
+  setting_fill(emitter, SKINEMIT_LIFE, life, count);
+  for (int i = 0; i < count; i++) {
+    life[i] = 1.0f / MAX(life[i], MIN_PARTICLE_LIFE);
+  }
+  setting_fill(emitter, SKINEMIT_X, &emitter->particles[SKINPARTICLE_X]->values[first], count);
+  setting_fill(emitter, SKINEMIT_Y, &emitter->particles[SKINPARTICLE_Y]->values[first], count);
+  setting_fill(emitter, SKINEMIT_VX, &emitter->particles[SKINPARTICLE_VX]->values[first], count);
+  setting_fill(emitter, SKINEMIT_VY, &emitter->particles[SKINPARTICLE_VY]->values[first], count);
+  setting_fill(emitter, SKINEMIT_R, &emitter->particles[SKINPARTICLE_R]->values[first], count);
+  setting_fill(emitter, SKINEMIT_G, &emitter->particles[SKINPARTICLE_G]->values[first], count);
+  setting_fill(emitter, SKINEMIT_B, &emitter->particles[SKINPARTICLE_B]->values[first], count);
+  setting_fill(emitter, SKINEMIT_A, &emitter->particles[SKINPARTICLE_A]->values[first], count);
+  memset(&emitter->particles[SKINPARTICLE_AGE]->values[first], 0, sizeof(float) * count);
+  emitter->num_particles += count;
+}
+
+/**
+ * @brief move every particle along by delta seconds, remove the ones that died and spawn the new
+ * ones for this frame
+*/
+void particle_update(skin_t* skin, float delta) {
+  for (int i = 0; i < skin->num_emitters; i++) {
+    skin_emitter_t* emitter = &skin->emitters[i];
+    if (emitter->num_particles > 0) {
+      float ax = setting_value(emitter, SKINEMIT_AX);
+      float ay = setting_value(emitter, SKINEMIT_AY);
+      particles_integrate(emitter, ax, ay, delta);
+      skin_item_t* item = &skin->items[emitter->item];
+      particles_compact(emitter, skin->fixed_tick && item->tick_buffer != NULL ? item : NULL);
+    }
+    particles_spawn(emitter, delta);
+    for (int a = 0; a < NUM_SKINPARTICLE; a++) {
+      emitter->particles[a]->num_values = emitter->num_particles;
+    }
+  }
+}
@@ -0,0 +1,13 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "skin.h"
+
+void particle_init(skin_t* skin);
+void particle_update(skin_t* skin, float delta);
+
+#ifdef __cplusplus
+}
+#endif
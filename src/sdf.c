@@ -0,0 +1,95 @@
+/** @file Signed distance fields from coverage bitmaps
+ * @author Hunter Whyte
+*/
+#include "sdf.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "skin.h"
+
+// squared distance of a pixel with nothing to measure to, big enough to lose to any real distance
+// while staying finite so the parabola intersections below never see inf - inf
+#define SDF_FAR 1e20f
+
+/**
+ * @brief 1d squared distance transform of n samples of f spaced stride apart, in place. v and z
+ * hold the lower envelope of the parabolas rooted at each sample, d is scratch for the result.
+*/
+static void edt_1d(float* f, int n, int stride, float* d, int* v, float* z) {
+  int k = 0;
+  v[0] = 0;
+  z[0] = -SDF_FAR;
+  z[1] = SDF_FAR;
+  for (int q = 1; q < n; q++) {
+    float fq = f[q * stride] + (float)q * q;
+    float s;
+    // drop parabolas from the envelope until the new one intersects the last one kept to its right
+    do {
+      int r = v[k];
+      s = (fq - (f[r * stride] + (float)r * r)) / (2.0f * (q - r));
+    } while (s <= z[k] && --k >= 0);
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = SDF_FAR;
+  }
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q) {
+      k++;
+    }
+    float dq = (float)(q - v[k]);
+    d[q] = dq * dq + f[v[k] * stride];
+  }
+  for (int q = 0; q < n; q++) {
+    f[q * stride] = d[q];
+  }
+}
+
+/**
+ * @brief squared distance from every pixel of grid to the nearest 0, columns first then rows
+*/
+static void edt_2d(float* grid, int width, int height, float* d, int* v, float* z) {
+  for (int x = 0; x < width; x++) {
+    edt_1d(&grid[x], height, width, d, v, z);
+  }
+  for (int y = 0; y < height; y++) {
+    edt_1d(&grid[y * width], width, 1, d, v, z);
+  }
+}
+
+void sdf_generate(const unsigned char* coverage, int width, int height, float spread,
+                  unsigned char* out) {
+  int len = width * height;
+  int longest = MAX(width, height);
+  // distance to the nearest inside pixel, and to the nearest outside pixel
+  float* to_inside = malloc(sizeof(float) * len);
+  float* to_outside = malloc(sizeof(float) * len);
+  float* d = malloc(sizeof(float) * longest);
+  float* z = malloc(sizeof(float) * (longest + 1));
+  int* v = malloc(sizeof(int) * longest);
+
+  for (int i = 0; i < len; i++) {
+    bool inside = coverage[i] >= 128;
+    to_inside[i] = inside ? 0.0f : SDF_FAR;
+    to_outside[i] = inside ? SDF_FAR : 0.0f;
+  }
+  edt_2d(to_inside, width, height, d, v, z);
+  edt_2d(to_outside, width, height, d, v, z);
+
+  // one of the two is always 0, the edge is half a pixel short of the nearest pixel across it
+  float scale = 127.0f / spread;
+  for (int i = 0; i < len; i++) {
+    float distance = sqrtf(to_outside[i]) - sqrtf(to_inside[i]);
+    distance += distance > 0 ? -0.5f : 0.5f;
+    float value = 128.0f + distance * scale;
+    out[i] = (unsigned char)(MIN(MAX(value, 0.0f), 255.0f) + 0.5f);
+  }
+
+  free(to_inside);
+  free(to_outside);
+  free(d);
+  free(z);
+  free(v);
+}
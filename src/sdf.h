@@ -0,0 +1,25 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Signed distance fields of 8 bit coverage bitmaps, for glyph maps that stay sharp at any size.
+ *
+ * A pixel with coverage of at least 128 is inside. The field stores the distance from each pixel
+ * centre to the edge, which sits halfway between an inside pixel and its outside neighbour,
+ * positive inside. Distances are exact euclidean distances between pixel centres, worked out with
+ * the separable squared distance transform of Felzenszwalb and Huttenlocher in linear time.
+ */
+
+/**
+ * @brief write the field of coverage to out, 128 + 127 * distance / spread clamped to 0-255, so
+ * the edge is at 128 and pixels spread or more away from it saturate. A bitmap with no inside (or
+ * no outside) pixels is all 0 (or all 255).
+ */
+void sdf_generate(const unsigned char* coverage, int width, int height, float spread,
+                  unsigned char* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,6 +3,16 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "animation.h"
+#include "draw.h"
+#include "fastmath.h"
+#include "item.h"
+#include "noise.h"
+#include "particle.h"
+#include "temporal.h"
+#include "vecops.h"
 
 void skin_init(skin_t** skin_out, skin_input_t* inputs, int num_inputs) {
   skin_t* skin = malloc(sizeof(skin_t));
@@ -12,22 +22,201 @@ void skin_init(skin_t** skin_out, skin_input_t* inputs, int num_inputs) {
   // create nodes based on the set of inputs provided
   for (int i = 0; i < num_inputs; i++) {
     for (int j = 0; j < inputs[i].num_nodes; j++) {
-      snprintf(skin->node_pool[skin->num_nodes].name, MAX_NAME_LENGTH, "%s_%s", inputs[i].name,
-               inputs[i].nodes[j].name);
-      inputs[i].nodes[j].node = &skin->node_pool[skin->num_nodes];
-      skin->num_nodes++;
+      skin_node_t* node = node_alloc(skin);
+      snprintf(node->name, MAX_NAME_LENGTH, "%s_%s", inputs[i].name, inputs[i].nodes[j].name);
+      node->width = MIN(MAX(inputs[i].nodes[j].width, 1), MAX_WIDTH);
+      inputs[i].nodes[j].node = node;
     }
   }
 
+  skin->clock.frame = 0;
+  skin->clock.delta = 0;
+  skin->clock.time = 0;
+  animation_init(skin);
+  particle_init(skin);
+  item_init(skin);
+  draw_init(skin);
+
   *skin_out = skin;
   return;
 }
 
 void skin_deinit(skin_t* skin) {
+  draw_deinit(skin);
+  item_deinit(skin);
+  for (int i = 0; i < skin->num_nodes; i++) {
+    temporal_free(&skin->node_pool[i]);
+  }
   free(skin);
 }
 
-void node_evaluate(skin_node_t* root) {
+/**
+ * @brief advance and evaluate the skin for a new frame. In fixed tick mode the graph is only
+ * evaluated by skin_tick and delta is instead the fraction (0-1) of the way from the previous tick
+ * to the current one that this frame should be drawn at. The frame's draw commands are then built
+ * and handed to the backend.
+*/
+void skin_draw(skin_t* skin, float delta) {
+  if (skin->fixed_tick) {
+    items_interpolate(skin, delta);
+  } else {
+    skin->clock.frame++;
+    skin->clock.delta = delta;
+    skin->clock.time += delta;
+    animation_update(skin, delta);
+    particle_update(skin, delta);
+    items_evaluate(skin);
+  }
+  draw_build(skin, skin->draw_list);
+  if (skin->backend.execute != NULL) {
+    skin->backend.execute(skin->backend.user, skin->draw_list);
+  }
+}
+
+void skin_set_backend(skin_t* skin, void (*execute)(void* user, const draw_list_t* list),
+                      void* user) {
+  skin->backend.execute = execute;
+  skin->backend.user = user;
+}
+
+/**
+ * @brief fixed tick mode only, advance the skin by delta seconds and evaluate the node graph
+*/
+void skin_tick(skin_t* skin, float delta) {
+  if (!skin->fixed_tick) {
+    return;
+  }
+  skin->clock.frame++;
+  skin->clock.delta = delta;
+  skin->clock.time += delta;
+  animation_update(skin, delta);
+  particle_update(skin, delta);
+  items_tick(skin);
+}
+
+/**
+ * @brief helper for allocating a new node from skin pool
+*/
+skin_node_t* node_alloc(skin_t* skin) {
+  assert(skin->num_nodes < NODE_POOL_SIZE);
+  skin_node_t* node = &skin->node_pool[skin->num_nodes];
+  skin->num_nodes++;
+  memset(node, 0, sizeof(skin_node_t));
+  node->num_values = 0;
+  return node;
+}
+
+/**
+ * @brief the float values of a node, mask nodes fill them in from their bits the first time they
+ * are asked for after an evaluation
+*/
+static const float* node_floats(skin_node_t* node) {
+  if (node->type == SKINTYPE_MASK && !node->mask_expanded) {
+    vec_mask_to_floats(node->values, node->bits, node->num_values);
+    node->mask_expanded = true;
+  }
+  return node->values;
+}
+
+static bool op_is_comparison(skin_operator op) {
+  return op == SKINOP_LESSTHAN || op == SKINOP_GREATERTHAN || op == SKINOP_EQUALS;
+}
+
+static bool op_is_reduction(skin_operator op) {
+  return op == SKINOP_SUM || op == SKINOP_COUNT || op == SKINOP_REDUCE_MIN ||
+         op == SKINOP_REDUCE_MAX || op == SKINOP_SCAN;
+}
+
+static int node_elements(const skin_node_t* node) {
+  return node->num_values / node_width(node);
+}
+
+// operands of vector operators get laid out here when they don't already match the result. These
+// are only written once every child of the node using them has been evaluated, so one pair is
+// enough for a whole tree. Each thread gets its own pair so skins can be evaluated in parallel.
+static _Thread_local float widen_scratch[2][MAX_VALUES];
+
+/**
+ * @brief the values of node as num_elements elements of width components. The last element is
+ * extended past the end of the node, scalars are applied to every component and an empty node
+ * reads as 0. Returns the node's own values when they are already laid out like that, otherwise
+ * fills in out.
+*/
+static const float* node_widen(skin_node_t* node, float* out, int num_elements, int width) {
+  const float* values = node_floats(node);
+  int node_w = node_width(node);
+  int node_n = node_elements(node);
+  if (node_w == width && node_n >= num_elements) {
+    return values;
+  }
+  if (node_n == 0) {
+    memset(out, 0, sizeof(float) * num_elements * width);
+    return out;
+  }
+  for (int i = 0; i < num_elements; i++) {
+    const float* element = &values[MIN(i, node_n - 1) * node_w];
+    for (int c = 0; c < width; c++) {
+      out[i * width + c] = element[node_w == 1 ? 0 : c];
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief copy node into out laid out as num_elements elements of width components, see node_widen
+*/
+static void node_broadcast(float* out, skin_node_t* node, int num_elements, int width) {
+  const float* values = node_widen(node, out, num_elements, width);
+  if (values != out) {
+    memcpy(out, values, sizeof(float) * num_elements * width);
+  }
+}
+
+/**
+ * @brief reductions and scans of a vector node work on every component as an array of its own
+*/
+static void node_reduce_components(skin_node_t* root, int width) {
+  const float* values = node_floats(root->child);
+  int num_elements = node_elements(root->child);
+  float* lane = widen_scratch[0];
+  for (int c = 0; c < width; c++) {
+    for (int i = 0; i < num_elements; i++) {
+      lane[i] = values[i * width + c];
+    }
+    switch (root->op) {
+      case (SKINOP_SUM):
+        root->values[c] = vec_sum(lane, num_elements);
+        break;
+      case (SKINOP_COUNT):
+        root->values[c] = (float)vec_count(lane, num_elements);
+        break;
+      case (SKINOP_REDUCE_MIN):
+        root->values[c] = vec_min(lane, num_elements);
+        break;
+      case (SKINOP_REDUCE_MAX):
+        root->values[c] = vec_max(lane, num_elements);
+        break;
+      default:
+        vec_scan(lane, num_elements);
+        for (int i = 0; i < num_elements; i++) {
+          root->values[i * width + c] = lane[i];
+        }
+        break;
+    }
+  }
+  if (root->op == SKINOP_SCAN) {
+    root->num_values = num_elements * width;
+  } else if (num_elements == 0 && root->op != SKINOP_SUM && root->op != SKINOP_COUNT) {
+    root->num_values = 0;
+  } else {
+    root->num_values = width;
+  }
+}
+
+/**
+ * @brief evaluate the tree below root, results may be left as masks
+*/
+static void node_eval(skin_node_t* root) {
   // =============== LEAF NODE ===============
 
   // if this is a leaf node then we don't need to evaluate anything and can just
@@ -43,37 +232,293 @@ void node_evaluate(skin_node_t* root) {
     assert(0);
   }
 
-  node_evaluate(root->child);
+  // stateful nodes only step once per frame, evaluating one again in the same frame (a node
+  // shared by several fields) gives back the values it already has
+  if (op_is_stateful(root->op) && root->clock != NULL && root->state != NULL &&
+      root->frame == root->clock->frame) {
+    return;
+  }
+
+  node_eval(root->child);
+  root->type = SKINTYPE_FLOAT;
+  int width = node_width(root);
+
+  // =============== STATEFUL OPERATORS ===============
+
+  if (op_is_stateful(root->op)) {
+    // settings are single values, an empty one leaves x unchanged like any other argument
+    float params[2] = {0, 0};
+    skin_node_t* settings[2] = {root->arg, root->arg2};
+    for (int i = 0; i < 2; i++) {
+      if (settings[i] == NULL) {
+        continue;
+      }
+      node_eval(settings[i]);
+      if (settings[i]->num_values == 0) {
+        memcpy(root->values, node_floats(root->child), sizeof(float) * root->child->num_values);
+        root->num_values = root->child->num_values;
+        return;
+      }
+      params[i] = node_floats(settings[i])[0];
+    }
+    temporal_evaluate(root, node_floats(root->child), root->child->num_values, params);
+    return;
+  }
 
   // =============== UNARY OPERATORS ===============
 
   if (root->op == SKINOP_NEGATE) {
+    const float* child_vals = node_floats(root->child);
     for (int i = 0; i < root->child->num_values; i++) {
-      root->values[i] = root->child->values[i] * -1;
+      root->values[i] = child_vals[i] * -1;
     }
     root->num_values = root->child->num_values;
     return;
   }
 
+  if (width > 1 && op_is_reduction(root->op)) {
+    node_reduce_components(root, width);
+    return;
+  }
+
+  if (root->op == SKINOP_COUNT && width == 1 && root->child->type == SKINTYPE_MASK) {
+    root->values[0] = (float)vec_mask_count(root->child->bits, root->child->num_values);
+    root->num_values = 1;
+    return;
+  }
+
+  if (op_is_unary(root->op)) {
+    int len = root->child->num_values;
+    float* root_vals = root->values;
+    memcpy(root_vals, node_floats(root->child), sizeof(float) * len);
+    root->num_values = len;
+
+    switch (root->op) {
+      case (SKINOP_SIN):
+        fast_sin(root_vals, len);
+        break;
+      case (SKINOP_COS):
+        fast_cos(root_vals, len);
+        break;
+      case (SKINOP_EXP):
+        fast_exp(root_vals, len);
+        break;
+      case (SKINOP_CLAMP):
+        fast_clamp(root_vals, len);
+        break;
+      case (SKINOP_SMOOTHSTEP):
+        fast_smoothstep(root_vals, len);
+        break;
+      case (SKINOP_EASE_IN):
+        fast_ease_in(root_vals, len);
+        break;
+      case (SKINOP_EASE_OUT):
+        fast_ease_out(root_vals, len);
+        break;
+      case (SKINOP_EASE_IN_OUT):
+        fast_ease_in_out(root_vals, len);
+        break;
+      // reductions always give a single value, except min and max of nothing which is nothing
+      case (SKINOP_SUM):
+        root_vals[0] = vec_sum(root_vals, len);
+        root->num_values = 1;
+        break;
+      case (SKINOP_COUNT):
+        root_vals[0] = (float)vec_count(root_vals, len);
+        root->num_values = 1;
+        break;
+      case (SKINOP_REDUCE_MIN):
+        root_vals[0] = vec_min(root_vals, len);
+        root->num_values = MIN(len, 1);
+        break;
+      case (SKINOP_REDUCE_MAX):
+        root_vals[0] = vec_max(root_vals, len);
+        root->num_values = MIN(len, 1);
+        break;
+      case (SKINOP_SCAN):
+        vec_scan(root_vals, len);
+        break;
+      default:
+        printf("ERROR MALFORMED NODE\n");
+        assert(0);
+        break;
+    }
+    return;
+  }
+
   if (root->arg == NULL) {
     printf("ERROR MALFORMED NODE\n");
     assert(0);
   }
 
+  // =============== TERNARY OPERATORS ===============
+
+  if (op_is_ternary(root->op) && root->arg2 == NULL) {
+    printf("ERROR MALFORMED NODE\n");
+    assert(0);
+  }
+
+  // select(cond, a, b), length follows cond and an empty branch reads as 0. A branch that no
+  // value of cond picks this frame is not evaluated at all.
+  if (root->op == SKINOP_SELECT) {
+    skin_node_t* cond = root->child;
+    skin_node_t* a = root->arg;
+    skin_node_t* b = root->arg2;
+    int num_elements = MIN(node_elements(cond), MAX_VALUES / width);
+    int len = num_elements * width;
+    bool mask = cond->type == SKINTYPE_MASK;
+    int num_true = mask ? vec_mask_count(cond->bits, cond->num_values)
+                        : vec_count(cond->values, cond->num_values);
+    bool any_true = num_true > 0;
+    bool any_false = num_true < cond->num_values;
+    root->num_values = len;
+
+    if (any_true) {
+      node_eval(a);
+    }
+    if (any_false) {
+      node_eval(b);
+    }
+    if (!any_false) {
+      node_broadcast(root->values, a, num_elements, width);
+      return;
+    }
+    if (!any_true) {
+      node_broadcast(root->values, b, num_elements, width);
+      return;
+    }
+
+    node_broadcast(root->values, a, num_elements, width);
+    if (width > 1) {
+      const float* cond_vals = node_widen(cond, widen_scratch[0], num_elements, width);
+      const float* b_vals = node_widen(b, widen_scratch[1], num_elements, width);
+      vec_blend(root->values, cond_vals, b_vals, len);
+      return;
+    }
+    const float* b_vals = node_floats(b);
+    int num_ops = MIN(len, b->num_values);
+    float last = b->num_values > 0 ? b_vals[b->num_values - 1] : 0.0f;
+    if (mask) {
+      vec_blend_mask(root->values, cond->bits, b_vals, num_ops);
+      vec_blend_mask_scalar(root->values, cond->bits, last, num_ops, len);
+    } else {
+      vec_blend(root->values, cond->values, b_vals, num_ops);
+      vec_blend_scalar(&root->values[num_ops], &cond->values[num_ops], last, len - num_ops);
+    }
+    return;
+  }
+
+  // lerp(a, b, t), length follows a which is left unchanged if b or t is empty
+  if (root->op == SKINOP_LERP) {
+    node_eval(root->arg);
+    node_eval(root->arg2);
+    int num_elements = MIN(node_elements(root->child), MAX_VALUES / width);
+    int len = num_elements * width;
+    node_broadcast(root->values, root->child, num_elements, width);
+    root->num_values = len;
+
+    const float* b = node_floats(root->arg);
+    const float* t = node_floats(root->arg2);
+    int b_len = root->arg->num_values;
+    int t_len = root->arg2->num_values;
+    if (b_len == 0 || t_len == 0) {
+      return;
+    }
+    if (width > 1) {
+      b = node_widen(root->arg, widen_scratch[0], num_elements, width);
+      t = node_widen(root->arg2, widen_scratch[1], num_elements, width);
+      b_len = len;
+      t_len = len;
+    }
+    int num_ops = MIN(len, MIN(b_len, t_len));
+    fast_lerp_each(root->values, b, t, num_ops);
+    for (int i = num_ops; i < len; i++) {  // extended operation
+      float bi = b[MIN(i, b_len - 1)];
+      float ti = t[MIN(i, t_len - 1)];
+      root->values[i] += (bi - root->values[i]) * ti;
+    }
+    return;
+  }
+
   // =============== BINARY OPERATORS ===============
 
-  node_evaluate(root->arg);
+  node_eval(root->arg);
+
+  // pack(a, b) puts the components of b after those of a, length follows a and an empty b reads
+  // as 0
+  if (root->op == SKINOP_PACK) {
+    int a_width = node_width(root->child);
+    int b_width = node_width(root->arg);
+    width = a_width + b_width;
+    int num_elements = MIN(node_elements(root->child), MAX_VALUES / width);
+    const float* a = node_floats(root->child);
+    const float* b = node_widen(root->arg, widen_scratch[0], num_elements, b_width);
+    for (int i = 0; i < num_elements; i++) {
+      for (int c = 0; c < a_width; c++) {
+        root->values[i * width + c] = a[i * a_width + c];
+      }
+      for (int c = 0; c < b_width; c++) {
+        root->values[i * width + a_width + c] = b[i * b_width + c];
+      }
+    }
+    root->num_values = num_elements * width;
+    return;
+  }
 
-  for (int i = 0; i < root->child->num_values; i++) {
-    root->values[i] = root->child->values[i];
+  // rand(seed, index) and noise(x, y) are as long as the longer argument, the shorter one has its
+  // last value extended and an empty one reads as 0
+  if (root->op == SKINOP_RAND || root->op == SKINOP_NOISE) {
+    int len = MAX(root->child->num_values, root->arg->num_values);
+    const float* a = node_widen(root->child, widen_scratch[0], len, 1);
+    const float* b = node_widen(root->arg, widen_scratch[1], len, 1);
+    if (root->op == SKINOP_RAND) {
+      noise_rand(root->values, a, b, len);
+    } else {
+      noise_value(root->values, a, b, len);
+    }
+    root->num_values = len;
+    return;
   }
-  root->num_values = root->child->num_values;
+
+  // vector results lay both operands out as whole elements of the result width, after that the
+  // kernels below run straight over the floats like for any other node
+  const float* child_vals;
+  const float* arg_vals = NULL;
+  int child_len = root->child->num_values;
+  int arg_len = root->arg->num_values;
+  if (width > 1) {
+    int num_elements = MIN(node_elements(root->child), MAX_VALUES / width);
+    child_len = num_elements * width;
+    child_vals = node_widen(root->child, widen_scratch[0], num_elements, width);
+    if (arg_len > 0) {
+      arg_vals = node_widen(root->arg, widen_scratch[1], num_elements, width);
+      arg_len = child_len;
+    }
+  } else {
+    child_vals = node_floats(root->child);
+  }
+
+  // comparisons only ever produce masks, they are stored as bits and skip the float copy below
+  if (op_is_comparison(root->op)) {
+    vec_compare cmp = root->op == SKINOP_LESSTHAN      ? VEC_LESS
+                      : root->op == SKINOP_GREATERTHAN ? VEC_GREATER
+                                                       : VEC_EQUAL;
+    root->num_values = child_len;
+    vec_compare_mask(root->bits, child_vals, arg_vals ? arg_vals : node_floats(root->arg), arg_len,
+                     child_len, cmp);
+    root->type = SKINTYPE_MASK;
+    root->mask_expanded = false;
+    return;
+  }
+
+  memcpy(root->values, child_vals, sizeof(float) * child_len);
+  root->num_values = child_len;
 
   // for arithmetic operators if the node length of the arg is less than the
   // node length of the child then we extend the arg values to the length of the
   // array we split this out now sot hat we can avoid doing conditional checking
   // every loop iteration to see if we exceeded the length of the arg node
-  int num_ops = MIN(root->num_values, root->arg->num_values);
+  int num_ops = MIN(root->num_values, arg_len);
 
   // if the argument node is empty then we just return without modifying
   if (num_ops == 0) {
@@ -84,18 +529,42 @@ void node_evaluate(skin_node_t* root) {
       case (SKINOP_DIVISOR):
       case (SKINOP_MIN):
       case (SKINOP_MAX):
+      case (SKINOP_POW):
+      case (SKINOP_FILTER):
         return;
       default:
         break;
     }
   }
 
-  float* arg_vals = root->arg->values;
-  int arg_len = root->arg->num_values;
-
   float* root_vals = root->values;
   int root_len = root->num_values;
 
+  // product and filter read a mask argument straight from its bits
+  if (arg_vals == NULL && root->arg->type == SKINTYPE_MASK &&
+      (root->op == SKINOP_PRODUCT || root->op == SKINOP_FILTER)) {
+    const uint32_t* bits = root->arg->bits;
+    int last = mask_get(bits, arg_len - 1);
+    if (root->op == SKINOP_PRODUCT) {
+      vec_product_mask(root_vals, bits, num_ops);
+      for (int i = num_ops; i < root_len; i++) {  // extended operation
+        root_vals[i] *= (float)last;
+      }
+    } else {
+      int kept = vec_filter_mask(root_vals, bits, num_ops);
+      if (last) {  // extended operation keeps everything past the mask
+        memmove(&root_vals[kept], &root_vals[num_ops], sizeof(float) * (root_len - num_ops));
+        kept += root_len - num_ops;
+      }
+      root->num_values = kept;
+    }
+    return;
+  }
+
+  if (arg_vals == NULL) {
+    arg_vals = node_floats(root->arg);
+  }
+
   // we are doing loops inside of op switch because we only need to evaluate op
   // once
   // TODO figure out what this actually compiles to vs. the alternative
@@ -158,40 +627,19 @@ void node_evaluate(skin_node_t* root) {
         root_vals[i] = MAX(root_vals[i], arg_vals[arg_len - 1]);
       }
       break;
-    case (SKINOP_GREATERTHAN):
-      for (int i = 0; i < num_ops; i++) {
-        root_vals[i] = root_vals[i] > arg_vals[i] ? 1.0 : 0.0f;
-      }
-      for (int i = num_ops; i < root_len; i++) {  // extended operation
-        root_vals[i] = root_vals[i] > arg_vals[arg_len - 1] ? 1.0 : 0.0f;
-      }
+    case (SKINOP_POW):
+      fast_pow(root_vals, arg_vals, num_ops);
+      fast_pow_scalar(&root_vals[num_ops], arg_vals[arg_len - 1], root_len - num_ops);
       break;
-    case (SKINOP_LESSTHAN):
-      for (int i = 0; i < num_ops; i++) {
-        root_vals[i] = root_vals[i] < arg_vals[i] ? 1.0 : 0.0f;
-      }
-      for (int i = num_ops; i < root_len; i++) {  // extended operation
-        root_vals[i] = root_vals[i] < arg_vals[arg_len - 1] ? 1.0 : 0.0f;
-      }
-      break;
-    case (SKINOP_EQUALS):
-      for (int i = 0; i < num_ops; i++) {
-        if (((-EPSILON) < (root_vals[i] - arg_vals[i])) &&
-            ((root_vals[i] - arg_vals[i]) < (EPSILON))) {
-          root_vals[i] = 1.0f;
-        } else {
-          root_vals[i] = 0.0f;
-        }
-      }
-      for (int i = num_ops; i < root_len; i++) {  // extended operation
-        if (((-EPSILON) < (root_vals[i] - arg_vals[arg_len - 1])) &&
-            ((root_vals[i] - arg_vals[arg_len - 1]) < (EPSILON))) {
-          root_vals[i] = 1.0f;
-        } else {
-          root_vals[i] = 0.0f;
-        }
+    case (SKINOP_FILTER): {
+      int kept = vec_filter(root_vals, arg_vals, num_ops);
+      if (arg_vals[arg_len - 1] != 0.0f) {  // extended operation keeps everything past the mask
+        memmove(&root_vals[kept], &root_vals[num_ops], sizeof(float) * (root_len - num_ops));
+        kept += root_len - num_ops;
       }
+      root->num_values = kept;
       break;
+    }
     default:
       printf("ERROR MALFORMED NODE\n");
       assert(0);
@@ -199,4 +647,13 @@ void node_evaluate(skin_node_t* root) {
   }
 
   return;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief evaluate the tree below root and leave the results in root->values, whatever type they
+ * were computed as
+*/
+void node_evaluate(skin_node_t* root) {
+  node_eval(root);
+  node_floats(root);
+}
@@ -3,6 +3,9 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #define MIN(a, b) (a < b ? a : b)
 #define MAX(a, b) (a > b ? a : b)
 #define EPSILON 0.000001
@@ -24,9 +27,78 @@ typedef enum op {
   SKINOP_MAX,
   SKINOP_LESSTHAN,
   SKINOP_GREATERTHAN,
-  SKINOP_EQUALS
+  SKINOP_EQUALS,
+  // transcendental operators
+  SKINOP_SIN,  // unary
+  SKINOP_COS,  // unary
+  SKINOP_EXP,  // unary
+  SKINOP_POW,
+  // easing operators, all unary and clamp their input to 0-1
+  SKINOP_CLAMP,
+  SKINOP_SMOOTHSTEP,
+  SKINOP_EASE_IN,
+  SKINOP_EASE_OUT,
+  SKINOP_EASE_IN_OUT,
+  // array operators, these change the length of the result
+  SKINOP_FILTER,
+  SKINOP_SUM,         // unary
+  SKINOP_COUNT,       // unary
+  SKINOP_REDUCE_MIN,  // unary
+  SKINOP_REDUCE_MAX,  // unary
+  SKINOP_SCAN,        // unary
+  // ternary operators
+  SKINOP_SELECT,
+  SKINOP_LERP,
+  // vector operators
+  SKINOP_PACK,
+  // stateful operators, these carry values over from one frame to the next
+  SKINOP_SMOOTH,
+  SKINOP_SPRING,  // ternary
+  SKINOP_DELAY,
+  SKINOP_DDT,  // unary
+  // random operators, both are as long as the longer of their two arguments
+  SKINOP_RAND,
+  SKINOP_NOISE
 } skin_operator;
 
+/**
+ * @brief unary operators only have a child, written as _op(child). Negate is also unary but it
+ * has its own - syntax.
+ */
+static inline bool op_is_unary(skin_operator op) {
+  switch (op) {
+    case SKINOP_NEGATE:
+    case SKINOP_SIN:
+    case SKINOP_COS:
+    case SKINOP_EXP:
+    case SKINOP_CLAMP:
+    case SKINOP_SMOOTHSTEP:
+    case SKINOP_EASE_IN:
+    case SKINOP_EASE_OUT:
+    case SKINOP_EASE_IN_OUT:
+    case SKINOP_SUM:
+    case SKINOP_COUNT:
+    case SKINOP_REDUCE_MIN:
+    case SKINOP_REDUCE_MAX:
+    case SKINOP_SCAN:
+    case SKINOP_DDT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief ternary operators take a third argument, written as _op(child, arg, arg2)
+ */
+static inline bool op_is_ternary(skin_operator op) {
+  return op == SKINOP_SELECT || op == SKINOP_LERP || op == SKINOP_SPRING;
+}
+
+static inline bool op_is_stateful(skin_operator op) {
+  return op == SKINOP_SMOOTH || op == SKINOP_SPRING || op == SKINOP_DELAY || op == SKINOP_DDT;
+}
+
 typedef enum skin_error {
   SKINERR_SUCCESS = 0,
   SKINERR_EXPRESSION_ERROR,
@@ -34,6 +106,25 @@ typedef enum skin_error {
 
 #define MAX_NAME_LENGTH 256
 #define MAX_VALUES 4096
+
+/**
+ * @brief advanced once every time the skin evaluates its node graph, stateful nodes use it to
+ * step their state by the right amount exactly once per frame
+ */
+typedef struct skin_clock {
+  uint32_t frame;
+  float delta;  // seconds since the previous frame
+  double time;  // seconds since the skin was created, the sum of every delta
+} skin_clock_t;
+
+#define MASK_WORDS(len) (((len) + 31) / 32)
+
+// what a node's results are stored as
+typedef enum skin_value_type {
+  SKINTYPE_FLOAT = 0,
+  SKINTYPE_MASK,  // one bit per value, what the comparison operators produce
+} skin_value_type;
+
 /**
  * @brief The basic unit of the skin engine are nodes. A node performs an
  * operation or holds a value.
@@ -52,11 +143,38 @@ struct skin_node_t {
   skin_node_t* child;
   // second argument
   skin_node_t* arg;
+  // third argument, only used by ternary operators
+  skin_node_t* arg2;
 
   float values[MAX_VALUES];
   int num_values;
+  // number of components in each element, vectors are stored interleaved (xyxyxy) so num_values
+  // is always width * the number of elements. Decided when the node is parsed, 0 is the same as 1
+  int width;
+
+  // mask nodes keep their results in bits and only fill in values when a consumer that can't read
+  // masks asks for them, see node_floats
+  skin_value_type type;
+  bool mask_expanded;
+  uint32_t bits[MASK_WORDS(MAX_VALUES)];
+
+  // stateful operators keep whatever they need between frames in state, allocated the first time
+  // they run and freed with the skin
+  const skin_clock_t* clock;
+  uint32_t frame;  // clock frame the state was last advanced on, 0 if it never has been
+  double time;     // clock time the state was last advanced at
+  float* state;
+  int state_size;
+  int state_len;
+  int state_head;
+  int state_count;
 };
 
+#define MAX_WIDTH 4
+static inline int node_width(const skin_node_t* node) {
+  return node->width > 1 ? node->width : 1;
+}
+
 #define MAX_NODES 64
 #define MAX_INPUTS 256
 
@@ -64,6 +182,7 @@ typedef struct skin_input_node {
   char* name;
   char* description;
   skin_node_t* node;
+  int width;  // 2-4 for a vector input, 0 or 1 is a plain scalar
 } skin_input_node_t;
 
 typedef struct skin_input {
@@ -73,6 +192,230 @@ typedef struct skin_input {
   int num_nodes;
 } skin_input_t;
 
+#define MAX_ANIMATIONS 512
+#define MAX_ANIMATION_INSTANCES 256
+#define MAX_EVENTS 256
+/**
+ * @brief An animation is a node whose values are the progress (0-1) of every currently running
+ * instance of the animation, oldest first. Each trigger of the animation's event starts a new
+ * instance, so the node length is the number of instances in flight.
+ *
+ * Instances of one animation all share the same length so they always expire in the order they
+ * were started, this lets us keep the start times in a ring buffer and pop from the front.
+ */
+typedef struct skin_animation {
+  skin_node_t* node;
+  float length;  // seconds
+  double start[MAX_ANIMATION_INSTANCES];  // ring buffer of instance start times
+  int head;
+  int num_instances;
+  // position in the skin's list of active animations, -1 when no instances are running
+  int active_index;
+  // next animation triggered by the same event, -1 terminates the list
+  int next_on_event;
+} skin_animation_t;
+
+typedef struct skin_event {
+  char name[MAX_NAME_LENGTH];
+  // first animation in the list of animations triggered by this event, -1 if none
+  int first_animation;
+  // first emitter in the list of emitters that burst on this event, -1 if none
+  int first_emitter;
+} skin_event_t;
+
+#define MAX_EMITTERS 64
+// per particle arrays of an emitter, each one is a node named <emitter>_<array>
+typedef enum skin_particle_array {
+  SKINPARTICLE_X = 0,
+  SKINPARTICLE_Y,
+  SKINPARTICLE_VX,
+  SKINPARTICLE_VY,
+  SKINPARTICLE_AGE,  // 0 when spawned, 1 at the end of its life
+  SKINPARTICLE_R,
+  SKINPARTICLE_G,
+  SKINPARTICLE_B,
+  SKINPARTICLE_A,
+  NUM_SKINPARTICLE
+} skin_particle_array;
+
+// expressions that control an emitter
+typedef enum skin_emitter_setting {
+  SKINEMIT_RATE = 0,  // particles per second
+  SKINEMIT_BURST,     // particles spawned every time the emitter's event fires
+  // the rest give the starting values of the particles spawned on a frame, the nth new particle
+  // takes the nth value with the last one extended
+  SKINEMIT_LIFE,  // seconds
+  SKINEMIT_X,
+  SKINEMIT_Y,
+  SKINEMIT_VX,
+  SKINEMIT_VY,
+  SKINEMIT_R,
+  SKINEMIT_G,
+  SKINEMIT_B,
+  SKINEMIT_A,
+  // acceleration shared by every particle, only the first value is used
+  SKINEMIT_AX,
+  SKINEMIT_AY,
+  NUM_SKINEMIT
+} skin_emitter_setting;
+
+/**
+ * @brief A particle emitter spawns particles from its settings and moves them along every frame.
+ * Particles are kept as one array per property, the values of the particle nodes are the storage
+ * itself, so any expression can read them and the emitter's item draws them directly. Dead
+ * particles are swap removed, so the order of the arrays is not the order of spawning. In fixed
+ * tick mode the item's stored tick values are moved along with them so interpolation still pairs
+ * each particle with its own previous position.
+ */
+typedef struct skin_emitter {
+  char name[MAX_NAME_LENGTH];
+  skin_node_t* particles[NUM_SKINPARTICLE];
+  float inv_life[MAX_VALUES];  // age gained per second by each particle
+  int num_particles;
+  // ids of the particles spawned this frame, <emitter>_spawn. Ids count up from 0 over the life of
+  // the emitter so _rand(seed, <emitter>_spawn) gives every particle its own random values
+  skin_node_t* spawn;
+  uint32_t next_id;
+
+  // root node of each setting expression, NULL if the setting was not set
+  skin_node_t* settings[NUM_SKINEMIT];
+  float spawn_carry;  // fraction of a particle left over by the spawn rate
+  int pending_bursts;
+  // item in the emitter's layer that draws the particles
+  int item;
+  // next emitter triggered by the same event, -1 terminates the list
+  int next_on_event;
+} skin_emitter_t;
+
+// hierarchical timer wheel used to expire animation instances, each level has 64 slots and each
+// slot of a level spans all 64 slots of the level below. 1ms ticks over 4 levels gives us a range
+// of ~4.6 hours, anything longer than that is clamped
+#define TIMER_TICK 0.001
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_POOL_SIZE 4096
+
+typedef struct skin_timer {
+  uint64_t expiry;  // tick the timer fires on
+  int animation;    // index of animation whose oldest instance expires
+  int next;         // next timer in the same slot or free list, -1 terminates
+} skin_timer_t;
+
+typedef struct skin_timer_wheel {
+  uint64_t now;  // last tick that has been processed
+  int slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+  // bit n is set when slot n of the level has timers, lets the wheel jump over empty slots
+  uint64_t occupied[TIMER_WHEEL_LEVELS];
+  skin_timer_t timers[TIMER_POOL_SIZE];
+  int free_timers;
+} skin_timer_wheel_t;
+
+// fields of an item, x is the indexer and decides how many of the item get drawn
+typedef enum skin_field {
+  SKINFIELD_X = 0,
+  SKINFIELD_Y,
+  SKINFIELD_W,
+  SKINFIELD_H,
+  SKINFIELD_R,
+  SKINFIELD_G,
+  SKINFIELD_B,
+  SKINFIELD_A,
+  SKINFIELD_VALUE,  // number items only, the number shown
+  NUM_SKINFIELDS
+} skin_field;
+
+// how an item is blended over what was drawn before it
+typedef enum skin_blend {
+  SKINBLEND_ALPHA = 0,
+  SKINBLEND_ADD,
+} skin_blend;
+
+// how a number item writes out its value
+typedef struct skin_number_format {
+  int pad;          // minimum number of digits before the point, padded with zeros
+  int precision;    // digits after the point, up to 6
+  bool separators;  // comma between every group of three digits before the point
+} skin_number_format_t;
+
+#define MAX_ITEMS 1024
+#define MAX_LAYERS 64
+#define MAX_LAYER_ITEMS 256
+/**
+ * @brief An item is something that gets drawn, each of its fields is an expression whose
+ * evaluated values are handed to the renderer.
+ */
+typedef struct skin_item {
+  char name[MAX_NAME_LENGTH];
+  // root node of each field expression, NULL if the field was not set
+  skin_node_t* fields[NUM_SKINFIELDS];
+  unsigned texture;
+  skin_blend blend;
+  // number items draw their value field as text in font instead of drawing quads, h is the line
+  // height
+  bool number;
+  unsigned font;
+  skin_number_format_t format;
+
+  // evaluated field arrays to draw, these either point straight at the field node values or at
+  // the interpolated output when the skin is running in fixed tick mode
+  const float* values[NUM_SKINFIELDS];
+  int num_values[NUM_SKINFIELDS];
+  // distance between consecutive values of a field, fields set from a vector expression read
+  // straight out of its interleaved values
+  int strides[NUM_SKINFIELDS];
+  // component of the field node this field reads, a vector node is set on several fields at once
+  int components[NUM_SKINFIELDS];
+
+  // fixed tick mode keeps the field results of the last two ticks, allocated on demand
+  float* tick_buffer;
+  float* prev[NUM_SKINFIELDS];
+  float* cur[NUM_SKINFIELDS];
+  float* out[NUM_SKINFIELDS];
+  int prev_len[NUM_SKINFIELDS];
+  int cur_len[NUM_SKINFIELDS];
+} skin_item_t;
+
+#define MAX_DEFERRED_FRAMES 30
+typedef struct skin_layer {
+  char name[MAX_NAME_LENGTH];
+  // indices into the skin item pool in draw order
+  int items[MAX_LAYER_ITEMS];
+  int num_items;
+
+  // only evaluate the layer every update_every frames (ticks in fixed tick mode), 0 or 1 is every
+  // frame
+  int update_every;
+  // max number of evaluations per second of skin time, 0 is uncapped
+  float max_rate;
+  // layers with priority 0 are always evaluated, layers with higher numbers get deferred to a
+  // later frame, highest number first, when the frame has run over the skin's frame budget
+  int priority;
+
+  // shader program the layer is drawn with, 0 keeps whatever was used before
+  unsigned shader;
+  // set when the items of the layer don't overlap or don't care about their order, so they can be
+  // drawn grouped by texture and blend instead of in the order they were added
+  bool sort_items;
+
+  // scheduler state
+  int frames_since_update;
+  int deferred_frames;
+  double last_update;
+} skin_layer_t;
+
+typedef struct draw_list draw_list_t;
+typedef struct draw_scratch draw_scratch_t;
+/**
+ * @brief where skin_draw sends the commands it builds every frame, execute is called once per
+ * frame with the whole list. With no execute set the list is built and dropped.
+ */
+typedef struct skin_backend {
+  void (*execute)(void* user, const draw_list_t* list);
+  void* user;
+} skin_backend_t;
+
 #define NODE_POOL_SIZE 4096
 #define INPUT_VALUE_POOL_SIZE 4096
 #define LITERAL_POOL_SIZE 4096
@@ -80,12 +423,69 @@ typedef struct skin_t {
   // memory pool of nodes, gets allocated at parse time
   int num_nodes;
   skin_node_t node_pool[NODE_POOL_SIZE];
+
+  // seconds since skin was initialized, advanced by skin_draw
+  double time;
+  skin_clock_t clock;
+
+  skin_event_t events[MAX_EVENTS];
+  int num_events;
+
+  skin_animation_t animations[MAX_ANIMATIONS];
+  int num_animations;
+  // only the animations with running instances get touched every frame
+  int active_animations[MAX_ANIMATIONS];
+  int num_active_animations;
+  skin_timer_wheel_t timer_wheel;
+
+  skin_emitter_t emitters[MAX_EMITTERS];
+  int num_emitters;
+
+  skin_item_t items[MAX_ITEMS];
+  int num_items;
+  skin_layer_t layers[MAX_LAYERS];
+  int num_layers;
+
+  // when set the node graph only gets evaluated by skin_tick and skin_draw interpolates between
+  // the results of the last two ticks
+  bool fixed_tick;
+  // seconds of evaluation per frame before deferrable layers get pushed to a later frame, 0 is
+  // unlimited
+  float frame_budget;
+
+  // commands of the last frame drawn
+  draw_list_t* draw_list;
+  draw_scratch_t* draw_scratch;
+  skin_backend_t backend;
 } skin_t;
 
 void skin_init(skin_t** skin, skin_input_t* inputs, int num_inputs);
 void skin_deinit(skin_t* skin);
 void skin_draw(skin_t* skin, float delta);
+void skin_tick(skin_t* skin, float delta);
+void skin_set_fixed_tick(skin_t* skin, bool enabled);
+void skin_set_frame_budget(skin_t* skin, float seconds);
+void skin_set_backend(skin_t* skin, void (*execute)(void* user, const draw_list_t* list),
+                      void* user);
+
+skin_layer_t* skin_add_layer(skin_t* skin, const char* name);
+skin_item_t* skin_add_item(skin_t* skin, skin_layer_t* layer, const char* name);
+skin_error skin_item_set_field(skin_t* skin, skin_item_t* item, skin_field field,
+                               const char* expression);
+void skin_item_set_number(skin_item_t* item, unsigned font, const skin_number_format_t* format);
+
+skin_animation_t* skin_add_animation(skin_t* skin, const char* name, float length,
+                                     const char* event);
+int skin_find_event(skin_t* skin, const char* name);
+int skin_add_event(skin_t* skin, const char* name);
+void skin_trigger_event(skin_t* skin, int event);
+
+skin_emitter_t* skin_add_emitter(skin_t* skin, skin_layer_t* layer, const char* name,
+                                 const char* event);
+skin_error skin_emitter_set(skin_t* skin, skin_emitter_t* emitter, skin_emitter_setting setting,
+                            const char* expression);
 
+skin_node_t* node_alloc(skin_t* skin);
 void node_evaluate(skin_node_t* root);
 
 #ifdef __cplusplus
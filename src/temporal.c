@@ -0,0 +1,203 @@
+/** @file Stateful operators that carry values over from one frame to the next
+ * @author Hunter Whyte
+*/
+#include "temporal.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "skin.h"
+
+/**
+ * @brief make sure the node has at least size floats of state, state is cleared when it has to be
+ * reallocated
+*/
+static float* state_reserve(skin_node_t* node, int size) {
+  if (node->state_size < size) {
+    free(node->state);
+    node->state = calloc(size, sizeof(float));
+    node->state_size = size;
+    node->state_len = 0;
+    node->state_head = 0;
+    node->state_count = 0;
+  }
+  return node->state;
+}
+
+/**
+ * @brief make room for num_arrays arrays of len floats laid out one after the other, returns the
+ * stride between them. Capacity is rounded up so a slowly growing x doesn't reallocate every
+ * frame, and the first state_len values of each array are kept when it grows.
+*/
+static int state_arrays(skin_node_t* node, int num_arrays, int len) {
+  int capacity = node->state_size / num_arrays;
+  if (node->state != NULL && len <= capacity) {
+    return capacity;
+  }
+  int new_capacity = ((MAX(len, 1) + 63) / 64) * 64;
+  float* state = calloc(new_capacity * num_arrays, sizeof(float));
+  int keep = MIN(node->state_len, capacity);
+  for (int a = 0; a < num_arrays && keep > 0; a++) {
+    memcpy(&state[a * new_capacity], &node->state[a * capacity], sizeof(float) * keep);
+  }
+  free(node->state);
+  node->state = state;
+  node->state_size = new_capacity * num_arrays;
+  return new_capacity;
+}
+
+void temporal_free(skin_node_t* node) {
+  free(node->state);
+  node->state = NULL;
+  node->state_size = 0;
+}
+
+// =============== KERNELS ===============
+
+static void smooth_step(float* y, const float* x, float factor, int len) {
+  for (int i = 0; i < len; i++) {
+    y[i] += (x[i] - y[i]) * factor;
+  }
+}
+
+// semi-implicit euler, velocity first then position with the new velocity
+static void spring_step(float* pos, float* vel, const float* x, float k, float d, float h,
+                        int len) {
+  for (int i = 0; i < len; i++) {
+    vel[i] += (k * (x[i] - pos[i]) - d * vel[i]) * h;
+    pos[i] += vel[i] * h;
+  }
+}
+
+static void ddt_step(float* out, float* prev, const float* x, float inv_delta, int len) {
+  for (int i = 0; i < len; i++) {
+    out[i] = (x[i] - prev[i]) * inv_delta;
+    prev[i] = x[i];
+  }
+}
+
+// =============== OPERATORS ===============
+
+static void smooth_evaluate(skin_node_t* root, const float* x, int len, float rate, float delta) {
+  state_arrays(root, 1, len);
+  float* y = root->state;
+  int num_old = MIN(root->state_len, len);
+  // exact for any frame time, unlike scaling the rate by delta
+  smooth_step(y, x, 1.0f - expf(-MAX(rate, 0.0f) * delta), num_old);
+  memcpy(&y[num_old], &x[num_old], sizeof(float) * (len - num_old));
+  root->state_len = len;
+  memcpy(root->values, y, sizeof(float) * len);
+}
+
+static void spring_evaluate(skin_node_t* root, const float* x, int len, float k, float d,
+                            float delta) {
+  int capacity = state_arrays(root, 2, len);
+  float* pos = root->state;
+  float* vel = &pos[capacity];
+  int num_old = MIN(root->state_len, len);
+  delta = MIN(delta, SPRING_MAX_STEP * SPRING_MAX_STEPS);
+  int steps = (int)ceilf(delta / SPRING_MAX_STEP);
+  float h = steps > 0 ? delta / steps : 0.0f;
+  for (int s = 0; s < steps; s++) {
+    spring_step(pos, vel, x, k, d, h, num_old);
+  }
+  memcpy(&pos[num_old], &x[num_old], sizeof(float) * (len - num_old));
+  memset(&vel[num_old], 0, sizeof(float) * (len - num_old));
+  root->state_len = len;
+  memcpy(root->values, pos, sizeof(float) * len);
+}
+
+/**
+ * @brief the state is a ring of frames + 1 slots, each slot holds the length of x on that frame
+ * followed by its values. Slots are only as big as the longest x seen so far. state_len is the
+ * number of slots, state_head the next one to write and state_count how many have been written.
+ * elapsed is the number of clock frames since the last evaluation, the frames in between were
+ * skipped and held the previous x so it is repeated for them.
+*/
+static void delay_evaluate(skin_node_t* root, const float* x, int len, float frames_param,
+                           uint32_t elapsed) {
+  int frames = (int)MIN(MAX(frames_param, 0.0f), (float)MAX_DELAY_FRAMES);
+  int num_slots = frames + 1;
+  // round slots up so that small changes in length don't throw away the history
+  int slot_size = root->state_count > 0 ? root->state_size / root->state_len : 0;
+  if (len + 1 > slot_size || root->state_len != num_slots) {
+    slot_size = ((len + 1 + 63) / 64) * 64;
+    temporal_free(root);
+    state_reserve(root, slot_size * num_slots);
+    root->state_len = num_slots;
+  }
+
+  if (root->state_count > 0 && elapsed > 1) {
+    int repeats = (int)MIN(elapsed - 1, (uint32_t)num_slots);
+    const float* last = &root->state[((root->state_head - 1 + num_slots) % num_slots) * slot_size];
+    for (int r = 0; r < repeats; r++) {
+      float* slot = &root->state[root->state_head * slot_size];
+      memcpy(slot, last, sizeof(float) * ((int)last[0] + 1));
+      last = slot;
+      root->state_head = (root->state_head + 1) % num_slots;
+      root->state_count = MIN(root->state_count + 1, num_slots);
+    }
+  }
+
+  float* slot = &root->state[root->state_head * slot_size];
+  slot[0] = (float)len;
+  memcpy(&slot[1], x, sizeof(float) * len);
+  root->state_head = (root->state_head + 1) % num_slots;
+  root->state_count = MIN(root->state_count + 1, num_slots);
+
+  // until there is enough history the oldest frame we have stands in
+  int back = MIN(frames, root->state_count - 1);
+  int index = (root->state_head - 1 - back + num_slots) % num_slots;
+  const float* delayed = &root->state[index * slot_size];
+  root->num_values = (int)delayed[0];
+  memcpy(root->values, &delayed[1], sizeof(float) * root->num_values);
+}
+
+static void ddt_evaluate(skin_node_t* root, const float* x, int len, float delta) {
+  state_arrays(root, 1, len);
+  float* prev = root->state;
+  int num_old = MIN(root->state_len, len);
+  if (delta > 0) {
+    ddt_step(root->values, prev, x, 1.0f / delta, num_old);
+  } else {
+    // no time has passed, nothing has a rate of change yet
+    memset(root->values, 0, sizeof(float) * num_old);
+    memcpy(prev, x, sizeof(float) * num_old);
+  }
+  memset(&root->values[num_old], 0, sizeof(float) * (len - num_old));
+  memcpy(&prev[num_old], &x[num_old], sizeof(float) * (len - num_old));
+  root->state_len = len;
+}
+
+void temporal_evaluate(skin_node_t* root, const float* x, int len, const float* params) {
+  // step by the time since the state last moved rather than the last frame's delta, layers that
+  // only run every few frames would otherwise fall behind
+  float delta = 0.0f;
+  uint32_t elapsed = 1;
+  if (root->clock != NULL && root->frame != 0) {
+    delta = (float)(root->clock->time - root->time);
+    elapsed = root->clock->frame - root->frame;
+  } else if (root->clock != NULL) {
+    delta = root->clock->delta;
+  }
+  root->num_values = len;
+  switch (root->op) {
+    case (SKINOP_SMOOTH):
+      smooth_evaluate(root, x, len, params[0], delta);
+      break;
+    case (SKINOP_SPRING):
+      spring_evaluate(root, x, len, params[0], params[1], delta);
+      break;
+    case (SKINOP_DELAY):
+      delay_evaluate(root, x, len, params[0], elapsed);
+      break;
+    default:
+      ddt_evaluate(root, x, len, delta);
+      break;
+  }
+  if (root->clock != NULL) {
+    root->frame = root->clock->frame;
+    root->time = root->clock->time;
+  }
+}
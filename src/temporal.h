@@ -0,0 +1,34 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "skin.h"
+
+/**
+ * Stateful operators, each one keeps per value state in its node from one evaluation to the next
+ * and steps it by the clock time that passed in between, so nodes in layers that skip frames still
+ * move at the same speed:
+ *   _smooth(x, rate)       exponential approach to x, rate is in 1/seconds
+ *   _spring(x, k, d)       damped spring pulled towards x with stiffness k and damping d
+ *   _delay(x, frames)      x as it was the given number of clock frames ago
+ *   _ddt(x)                rate of change of x per second
+ * Values that did not exist on the previous evaluation start out settled at x (0 for ddt).
+ */
+
+#define MAX_DELAY_FRAMES 120
+// longest step the spring integrates in one go, longer frames get split up so it stays stable
+#define SPRING_MAX_STEP (1.0f / 120.0f)
+// most steps the spring takes in one evaluation, any time past that after a long stall is dropped
+#define SPRING_MAX_STEPS 32
+
+/**
+ * @brief step the state of a stateful node and write its output, params holds the first value of
+ * each of the node's settings
+ */
+void temporal_evaluate(skin_node_t* root, const float* x, int len, const float* params);
+void temporal_free(skin_node_t* node);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,362 @@
+/** @file Array kernels for operators that change the length of a node
+ * @author Hunter Whyte
+*/
+#include "vecops.h"
+
+#include <string.h>
+
+#include "skin.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the left pack needs pshufb, which is not part of the x86-64 baseline. It is built for ssse3 on
+// its own and picked at run time so the rest of the build doesn't have to require it.
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define LEFT_PACK
+#include <tmmintrin.h>
+
+// for every 4 bit movemask, the pshufb control that moves the selected float lanes to the front
+// clang-format off
+static const unsigned char left_pack[16][16] = {
+    {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {4, 5, 6, 7, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80},
+    {12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {4, 5, 6, 7, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 5, 6, 7, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80},
+    {8, 9, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 8, 9, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80},
+    {4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+};
+// clang-format on
+
+static const int popcount4[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+static bool left_pack_supported(void) {
+#ifdef __SSSE3__
+  return true;
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+/**
+ * @brief left pack 4 at a time, returns how many values were consumed and adds the number kept to
+ * kept. The store always writes a full vector at kept <= i, everything it overwrites past the
+ * packed values has either been loaded already or gets overwritten later.
+*/
+__attribute__((target("ssse3"))) static int filter_left_pack(float* values, const float* mask,
+                                                             int len, int* kept) {
+  const __m128 zero = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= len; i += 4) {
+    __m128 v = _mm_loadu_ps(&values[i]);
+    int bits = _mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(&mask[i]), zero));
+    __m128i control = _mm_loadu_si128((const __m128i*)left_pack[bits]);
+    __m128i packed = _mm_shuffle_epi8(_mm_castps_si128(v), control);
+    _mm_storeu_ps(&values[*kept], _mm_castsi128_ps(packed));
+    *kept += popcount4[bits];
+  }
+  return i;
+}
+
+// the mask bits are already the movemask the float version has to compute
+__attribute__((target("ssse3"))) static int filter_mask_left_pack(float* values,
+                                                                  const uint32_t* bits, int len,
+                                                                  int* kept) {
+  int i = 0;
+  for (; i + 4 <= len; i += 4) {
+    int nibble = (bits[i >> 5] >> (i & 31)) & 0xf;
+    __m128i control = _mm_loadu_si128((const __m128i*)left_pack[nibble]);
+    __m128i packed = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&values[i]), control);
+    _mm_storeu_si128((__m128i*)&values[*kept], packed);
+    *kept += popcount4[nibble];
+  }
+  return i;
+}
+#endif
+
+int vec_filter(float* values, const float* mask, int len) {
+  int kept = 0;
+  int i = 0;
+#ifdef LEFT_PACK
+  if (left_pack_supported()) {
+    i = filter_left_pack(values, mask, len, &kept);
+  }
+#endif
+  // always write and only advance when the value is kept, so there is no branch to mispredict
+  for (; i < len; i++) {
+    values[kept] = values[i];
+    kept += mask[i] != 0.0f;
+  }
+  return kept;
+}
+
+// =============== BLEND ===============
+
+// plain selects, with trapping math off these become a compare and a blend per vector
+void vec_blend(float* values, const float* mask, const float* other, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = mask[i] != 0.0f ? values[i] : other[i];
+  }
+}
+
+void vec_blend_scalar(float* values, const float* mask, float other, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = mask[i] != 0.0f ? values[i] : other;
+  }
+}
+
+// =============== MASKS ===============
+
+static inline int compare1(float a, float b, vec_compare cmp) {
+  switch (cmp) {
+    case VEC_LESS:
+      return a < b;
+    case VEC_GREATER:
+      return a > b;
+    default:
+      return (-EPSILON) < (a - b) && (a - b) < EPSILON;
+  }
+}
+
+#ifdef __SSE2__
+static inline __m128 compare4(__m128 a, __m128 b, vec_compare cmp) {
+  switch (cmp) {
+    case VEC_LESS:
+      return _mm_cmplt_ps(a, b);
+    case VEC_GREATER:
+      return _mm_cmpgt_ps(a, b);
+    default: {
+      // |a - b| < EPSILON, clearing the sign bit gives the absolute value
+      __m128 diff = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(a, b));
+      return _mm_cmplt_ps(diff, _mm_set1_ps((float)EPSILON));
+    }
+  }
+}
+#endif
+
+/**
+ * @brief compare whole words while both a and b have values, cmp is a constant at every call so
+ * the switches inside compile away
+*/
+static inline int compare_words(uint32_t* bits, const float* a, const float* b, int len,
+                                vec_compare cmp) {
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    uint32_t word = 0;
+#ifdef __SSE2__
+    for (int k = 0; k < 8; k++) {
+      __m128 c = compare4(_mm_loadu_ps(&a[i + 4 * k]), _mm_loadu_ps(&b[i + 4 * k]), cmp);
+      word |= (uint32_t)_mm_movemask_ps(c) << (4 * k);
+    }
+#else
+    for (int j = 0; j < 32; j++) {
+      word |= (uint32_t)compare1(a[i + j], b[i + j], cmp) << j;
+    }
+#endif
+    bits[i >> 5] = word;
+  }
+  return i;
+}
+
+void vec_compare_mask(uint32_t* bits, const float* a, const float* b, int b_len, int len,
+                      vec_compare cmp) {
+  memset(bits, 0, sizeof(uint32_t) * MASK_WORDS(len));
+  if (b_len == 0) {
+    return;
+  }
+  int num_full = MIN(len, b_len);
+  int i;
+  switch (cmp) {
+    case VEC_LESS:
+      i = compare_words(bits, a, b, num_full, VEC_LESS);
+      break;
+    case VEC_GREATER:
+      i = compare_words(bits, a, b, num_full, VEC_GREATER);
+      break;
+    default:
+      i = compare_words(bits, a, b, num_full, VEC_EQUAL);
+      break;
+  }
+  // whatever is left of the last word and the extended part of b
+  for (; i < len; i++) {
+    float bi = b[MIN(i, b_len - 1)];
+    bits[i >> 5] |= (uint32_t)compare1(a[i], bi, cmp) << (i & 31);
+  }
+}
+
+void vec_mask_to_floats(float* values, const uint32_t* bits, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = (float)mask_get(bits, i);
+  }
+}
+
+int vec_mask_count(const uint32_t* bits, int len) {
+  int count = 0;
+  for (int w = 0; w < MASK_WORDS(len); w++) {
+    count += __builtin_popcount(bits[w]);
+  }
+  return count;
+}
+
+int vec_filter_mask(float* values, const uint32_t* bits, int len) {
+  int kept = 0;
+  int i = 0;
+#ifdef LEFT_PACK
+  if (left_pack_supported()) {
+    i = filter_mask_left_pack(values, bits, len, &kept);
+  }
+#endif
+  for (; i < len; i++) {
+    values[kept] = values[i];
+    kept += mask_get(bits, i);
+  }
+  return kept;
+}
+
+void vec_blend_mask(float* values, const uint32_t* bits, const float* other, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] = mask_get(bits, i) ? values[i] : other[i];
+  }
+}
+
+void vec_blend_mask_scalar(float* values, const uint32_t* bits, float other, int start, int len) {
+  for (int i = start; i < len; i++) {
+    values[i] = mask_get(bits, i) ? values[i] : other;
+  }
+}
+
+void vec_product_mask(float* values, const uint32_t* bits, int len) {
+  for (int i = 0; i < len; i++) {
+    values[i] *= (float)mask_get(bits, i);
+  }
+}
+
+// =============== REDUCTIONS ===============
+
+// independent accumulators so consecutive adds don't wait on each other, and so the compiler can
+// keep them in vector registers without having to reassociate the float math itself
+#define LANES 8
+
+float vec_sum(const float* values, int len) {
+  float acc[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    for (int l = 0; l < LANES; l++) {
+      acc[l] += values[i + l];
+    }
+  }
+  for (; i < len; i++) {
+    acc[0] += values[i];
+  }
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int l = 0; l < width; l++) {
+      acc[l] += acc[l + width];
+    }
+  }
+  return acc[0];
+}
+
+int vec_count(const float* values, int len) {
+  int acc[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    for (int l = 0; l < LANES; l++) {
+      acc[l] += values[i + l] != 0.0f;
+    }
+  }
+  for (; i < len; i++) {
+    acc[0] += values[i] != 0.0f;
+  }
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int l = 0; l < width; l++) {
+      acc[l] += acc[l + width];
+    }
+  }
+  return acc[0];
+}
+
+float vec_min(const float* values, int len) {
+  if (len == 0) {
+    return 0.0f;
+  }
+  float acc[LANES];
+  for (int l = 0; l < LANES; l++) {
+    acc[l] = values[0];
+  }
+  int i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    for (int l = 0; l < LANES; l++) {
+      acc[l] = MIN(acc[l], values[i + l]);
+    }
+  }
+  for (; i < len; i++) {
+    acc[0] = MIN(acc[0], values[i]);
+  }
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int l = 0; l < width; l++) {
+      acc[l] = MIN(acc[l], acc[l + width]);
+    }
+  }
+  return acc[0];
+}
+
+float vec_max(const float* values, int len) {
+  if (len == 0) {
+    return 0.0f;
+  }
+  float acc[LANES];
+  for (int l = 0; l < LANES; l++) {
+    acc[l] = values[0];
+  }
+  int i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    for (int l = 0; l < LANES; l++) {
+      acc[l] = MAX(acc[l], values[i + l]);
+    }
+  }
+  for (; i < len; i++) {
+    acc[0] = MAX(acc[0], values[i]);
+  }
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int l = 0; l < width; l++) {
+      acc[l] = MAX(acc[l], acc[l + width]);
+    }
+  }
+  return acc[0];
+}
+
+// =============== SCAN ===============
+
+void vec_scan(float* values, int len) {
+  float total = 0.0f;
+  int i = 0;
+#ifdef __SSE2__
+  // scan each block of 4 in register with two shifted adds, then add on the running total of
+  // every block before it and broadcast the last lane as the next block's carry
+  __m128 carry = _mm_setzero_ps();
+  for (; i + 4 <= len; i += 4) {
+    __m128 x = _mm_loadu_ps(&values[i]);
+    x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+    x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+    x = _mm_add_ps(x, carry);
+    _mm_storeu_ps(&values[i], x);
+    carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  total = _mm_cvtss_f32(carry);
+#endif
+  for (; i < len; i++) {
+    total += values[i];
+    values[i] = total;
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Array kernels for masks and for operators that change the length of a node rather than mapping
+ * over it.
+ *
+ * Kernels that need a shuffle the compiler won't find on its own (left packing, in register scans)
+ * use SSE intrinsics when the target has them and otherwise fall back to branch free scalar loops.
+ * The rest are plain loops written for the auto vectorizer.
+ */
+
+/**
+ * @brief keep values[i] where mask[i] != 0, packing the kept values to the front in order.
+ * Works in place and returns the number of values kept.
+ */
+int vec_filter(float* values, const float* mask, int len);
+
+/**
+ * @brief replace values[i] with other[i] wherever mask[i] is zero
+ */
+void vec_blend(float* values, const float* mask, const float* other, int len);
+void vec_blend_scalar(float* values, const float* mask, float other, int len);
+
+// =============== MASKS ===============
+// Masks are packed 32 values to a word, lowest bit first. Bits past the end are always 0.
+
+typedef enum vec_compare {
+  VEC_LESS,
+  VEC_GREATER,
+  VEC_EQUAL,  // within EPSILON
+} vec_compare;
+
+/**
+ * @brief bits[i] = a[i] cmp b[i]. b is extended past b_len by repeating its last value and an empty
+ * b compares false everywhere.
+ */
+void vec_compare_mask(uint32_t* bits, const float* a, const float* b, int b_len, int len,
+                      vec_compare cmp);
+void vec_mask_to_floats(float* values, const uint32_t* bits, int len);
+int vec_mask_count(const uint32_t* bits, int len);
+// mask counterparts of vec_filter, vec_blend and multiplying by a 0/1 float mask
+int vec_filter_mask(float* values, const uint32_t* bits, int len);
+void vec_blend_mask(float* values, const uint32_t* bits, const float* other, int len);
+// only the values from start to len are blended, the tail of a broadcast
+void vec_blend_mask_scalar(float* values, const uint32_t* bits, float other, int start, int len);
+void vec_product_mask(float* values, const uint32_t* bits, int len);
+
+static inline int mask_get(const uint32_t* bits, int i) {
+  return (bits[i >> 5] >> (i & 31)) & 1;
+}
+
+// reductions, summed and compared in 8 independent lanes that are combined pairwise at the end
+float vec_sum(const float* values, int len);
+// number of values that are non zero, which for a mask is the length the filter would keep
+int vec_count(const float* values, int len);
+// min and max of an empty array have no meaningful value and return 0
+float vec_min(const float* values, int len);
+float vec_max(const float* values, int len);
+
+/**
+ * @brief inclusive prefix sum in place, values[i] becomes the sum of values[0] to values[i]
+ */
+void vec_scan(float* values, int len);
+
+#ifdef __cplusplus
+}
+#endif
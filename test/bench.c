@@ -0,0 +1,66 @@
+/** @file Timings of the per frame work, only reports numbers, nothing here passes or fails
+ * @author Hunter Whyte
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/particle.h"
+#include "../src/skin.h"
+
+#define BENCH_PARTICLES 50000
+#define BENCH_EMITTERS 13
+#define BENCH_FRAMES 200
+
+static double clock_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/**
+ * @brief time particle_update with BENCH_PARTICLES particles spread over BENCH_EMITTERS emitters
+ * that have reached a steady state
+*/
+static void bench_particles(void) {
+  skin_t* sk;
+  skin_init(&sk, NULL, 0);
+
+  // a second of life at this rate keeps each emitter a little under MAX_VALUES particles
+  char rate[16];
+  snprintf(rate, sizeof(rate), "%d", BENCH_PARTICLES / BENCH_EMITTERS + 1);
+  skin_layer_t* layer = skin_add_layer(sk, "effects");
+  for (int e = 0; e < BENCH_EMITTERS; e++) {
+    char name[16];
+    char vx[48];
+    snprintf(name, sizeof(name), "bench%d", e);
+    snprintf(vx, sizeof(vx), "_rand(1, %s_spawn) * 10", name);
+    skin_emitter_t* emitter = skin_add_emitter(sk, layer, name, NULL);
+    skin_emitter_set(sk, emitter, SKINEMIT_RATE, rate);
+    skin_emitter_set(sk, emitter, SKINEMIT_LIFE, "1");
+    skin_emitter_set(sk, emitter, SKINEMIT_VX, vx);
+    skin_emitter_set(sk, emitter, SKINEMIT_AY, "-9.8");
+  }
+
+  const float delta = 1.0f / 60.0f;
+  for (int frame = 0; frame < 90; frame++) {
+    particle_update(sk, delta);
+  }
+  int total = 0;
+  for (int e = 0; e < sk->num_emitters; e++) {
+    total += sk->emitters[e].num_particles;
+  }
+
+  double start = clock_ms();
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    particle_update(sk, delta);
+  }
+  double ms = (clock_ms() - start) / BENCH_FRAMES;
+  printf("particles: %d in %d emitters, %.3f ms per update\n", total, BENCH_EMITTERS, ms);
+
+  skin_deinit(sk);
+}
+
+int main(void) {
+  bench_particles();
+  return 0;
+}
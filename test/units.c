@@ -1,4 +1,11 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "../src/draw.h"
 #include "../src/expression.h"
+#include "../src/noise.h"
+#include "../src/particle.h"
+#include "../src/sdf.h"
 #include "../src/skin.h"
 #include "test.h"
 
@@ -24,11 +31,13 @@ skin_input_t inputs[] = {{.name = "example",
                               {
                                   {.name = "y", .description = "the y position of the thing"},
                                   {.name = "girth", .description = "the girth of the thing"},
+                                  {.name = "pos", .description = "xy of the thing", .width = 2},
                               },
-                          .num_nodes = 2}
+                          .num_nodes = 3}
 #define example2 inputs[1]
 #define example2_y example2.nodes[0]
 #define example2_girth example2.nodes[1]
+#define example2_pos example2.nodes[2]
 };
 
 TEST(expression_parser, basic_add) {
@@ -247,6 +256,61 @@ TEST(expression_parser, multiple_lookup) {
   return 0;
 }
 
+TEST(expression_parser, unary_function) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_node_t* node = expression_parse(sk, "_sin(example_x)");
+  print_node_tree(node, 0);
+
+  ASSERT_EQ(node->op, SKINOP_SIN);
+  ASSERT_EQ(example_x.node, node->child);
+  ASSERT_EQ(node->arg, NULL);
+
+  node = expression_parse(sk, "_sin(1, 1)");
+  ASSERT_EQ(node, NULL);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(expression_parser, nested_function) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_node_t* node = expression_parse(sk, "_pow(_ease_in(example_x), 2) + 1");
+  print_node_tree(node, 0);
+
+  ASSERT_EQ(node->op, SKINOP_ADD);
+  ASSERT_EQ(node->child->op, SKINOP_POW);
+  ASSERT_EQ(node->child->child->op, SKINOP_EASE_IN);
+  ASSERT_EQ(example_x.node, node->child->child->child);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(expression_parser, ternary_function) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_node_t* node = expression_parse(sk, "_select((example_x > 1), example_size, -2)");
+  print_node_tree(node, 0);
+  ASSERT(node != NULL);
+  ASSERT_EQ(node->op, SKINOP_SELECT);
+  ASSERT(node->child->op == SKINOP_GREATERTHAN);
+  ASSERT(node->arg == example_size.node);
+  ASSERT_FLOAT_EQ(node->arg2->values[0], -2.0f);
+
+  // ternary operators need all three arguments and nothing else takes a third
+  ASSERT(expression_parse(sk, "_select(1, 2)") == NULL);
+  ASSERT(expression_parse(sk, "_add(1, 2, 3)") == NULL);
+  ASSERT(expression_parse(sk, "_lerp(1, 2, 3, 4)") == NULL);
+
+  skin_deinit(sk);
+  return 0;
+}
+
 SUITE(expression_generator);
 
 TEST(expression_generator, basic_generate) {
@@ -346,6 +410,49 @@ TEST(expression_generator, self_generate) {
   return 0;
 }
 
+TEST(expression_generator, function_generate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_node_t* node = expression_parse(sk, "_smoothstep((_sin(example_x) * 0.5)) + _pow(2, 3)");
+  print_node_tree(node, 0);
+
+  char buf1[256];
+  expression_generate(node, buf1, 256);
+  printf("generated %s\n", buf1);
+
+  ASSERT_STRING_EQ("_add(_smoothstep(_product(_sin(example_x),0.5)),_pow(2,3))", buf1);
+
+  node = expression_parse(sk, buf1);
+  char buf2[256];
+  expression_generate(node, buf2, 256);
+  printf("generated %s\n", buf2);
+
+  ASSERT_STRING_EQ(buf1, buf2);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(expression_generator, ternary_generate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_node_t* node = expression_parse(sk, "_lerp(example_x, _select(example_x, 1, 2), 0.5) * 2");
+  char buf1[256];
+  expression_generate(node, buf1, 256);
+  printf("generated %s\n", buf1);
+  ASSERT_STRING_EQ("_product(_lerp(example_x,_select(example_x,1,2),0.5),2)", buf1);
+
+  node = expression_parse(sk, buf1);
+  char buf2[256];
+  expression_generate(node, buf2, 256);
+  ASSERT_STRING_EQ(buf1, buf2);
+
+  skin_deinit(sk);
+  return 0;
+}
+
 SUITE(node_evaluator);
 
 TEST(node_evaluator, basic_evaluate) {
@@ -671,8 +778,1318 @@ TEST(node_evaluator, equality_none_evaluate) {
   return 0;
 }
 
+TEST(node_evaluator, trig_evaluate) {
+  skin_node_t child = {.values = {0, 1.5707963f, 3.1415926f, -100}, .num_values = 4};
+  skin_node_t sin_root = {.child = &child, .op = SKINOP_SIN};
+  skin_node_t cos_root = {.child = &child, .op = SKINOP_COS};
+  node_evaluate(&sin_root);
+  node_evaluate(&cos_root);
+  print_node_tree_verbose(&sin_root, 0);
+  ASSERT_EQ(sin_root.num_values, 4);
+  ASSERT(fabsf(sin_root.values[0] - 0.0f) < 1e-6);
+  ASSERT(fabsf(sin_root.values[1] - 1.0f) < 1e-6);
+  ASSERT(fabsf(sin_root.values[2] - 0.0f) < 1e-6);
+  ASSERT(fabsf(sin_root.values[3] - sinf(-100)) < 1e-6);
+  ASSERT(fabsf(cos_root.values[0] - 1.0f) < 1e-6);
+  ASSERT(fabsf(cos_root.values[2] + 1.0f) < 1e-6);
+  ASSERT(fabsf(cos_root.values[3] - cosf(-100)) < 1e-6);
+  return 0;
+}
+
+TEST(node_evaluator, pow_evaluate) {
+  skin_node_t left = {.values = {2, 9, 0}, .num_values = 3};
+  skin_node_t right = {.values = {3, 0.5f}, .num_values = 2};
+  skin_node_t root = {.child = &left, .arg = &right, .op = SKINOP_POW};
+  node_evaluate(&root);
+  print_node_tree_verbose(&root, 0);
+  ASSERT_EQ(root.num_values, 3);
+  ASSERT(fabsf(root.values[0] - 8.0f) < 1e-5);
+  ASSERT(fabsf(root.values[1] - 3.0f) < 1e-5);
+  ASSERT_FLOAT_EQ(root.values[2], 0.0f);
+  return 0;
+}
+
+TEST(node_evaluator, exp_evaluate) {
+  skin_node_t child = {.values = {0, 1, -2, 200}, .num_values = 4};
+  skin_node_t root = {.child = &child, .op = SKINOP_EXP};
+  node_evaluate(&root);
+  print_node_tree_verbose(&root, 0);
+  ASSERT_FLOAT_EQ(root.values[0], 1.0f);
+  ASSERT(fabsf(root.values[1] - 2.7182818f) < 1e-6);
+  ASSERT(fabsf(root.values[2] - 0.1353353f) < 1e-6);
+  // saturates instead of going to inf
+  ASSERT(root.values[3] > 1e38 && root.values[3] < INFINITY);
+  return 0;
+}
+
+TEST(node_evaluator, easing_evaluate) {
+  skin_node_t child = {.values = {-1, 0.25f, 0.5f, 0.75f, 2}, .num_values = 5};
+  skin_node_t clamp = {.child = &child, .op = SKINOP_CLAMP};
+  skin_node_t smooth = {.child = &child, .op = SKINOP_SMOOTHSTEP};
+  skin_node_t in = {.child = &child, .op = SKINOP_EASE_IN};
+  skin_node_t out = {.child = &child, .op = SKINOP_EASE_OUT};
+  skin_node_t in_out = {.child = &child, .op = SKINOP_EASE_IN_OUT};
+  node_evaluate(&clamp);
+  node_evaluate(&smooth);
+  node_evaluate(&in);
+  node_evaluate(&out);
+  node_evaluate(&in_out);
+
+  ASSERT_FLOAT_EQ(clamp.values[0], 0.0f);
+  ASSERT_FLOAT_EQ(clamp.values[4], 1.0f);
+  ASSERT_FLOAT_EQ(smooth.values[1], 0.15625f);
+  ASSERT_FLOAT_EQ(smooth.values[2], 0.5f);
+  ASSERT_FLOAT_EQ(in.values[1], 0.015625f);
+  ASSERT_FLOAT_EQ(out.values[1], 0.578125f);
+  ASSERT_FLOAT_EQ(in_out.values[1], 0.0625f);
+  ASSERT_FLOAT_EQ(in_out.values[2], 0.5f);
+  ASSERT_FLOAT_EQ(in_out.values[3], 0.9375f);
+  ASSERT_FLOAT_EQ(in_out.values[4], 1.0f);
+  return 0;
+}
+
+TEST(node_evaluator, filter_evaluate) {
+  skin_node_t values = {.num_values = 37};
+  skin_node_t mask = {.num_values = 37};
+  for (int i = 0; i < 37; i++) {
+    values.values[i] = i;
+    mask.values[i] = (i % 3 == 0 || i % 7 == 0) ? 1.0f : 0.0f;
+  }
+  skin_node_t root = {.child = &values, .arg = &mask, .op = SKINOP_FILTER};
+  node_evaluate(&root);
+  print_node_tree_verbose(&root, 0);
+  int expected = 0;
+  for (int i = 0; i < 37; i++) {
+    if (i % 3 == 0 || i % 7 == 0) {
+      ASSERT_FLOAT_EQ(root.values[expected], (float)i);
+      expected++;
+    }
+  }
+  ASSERT_EQ(root.num_values, expected);
+  return 0;
+}
+
+TEST(node_evaluator, filter_short_mask_evaluate) {
+  skin_node_t values = {.values = {1, 2, 3, 4, 5, 6}, .num_values = 6};
+  skin_node_t keep_rest = {.values = {0, 1}, .num_values = 2};
+  skin_node_t drop_rest = {.values = {1, 0}, .num_values = 2};
+  skin_node_t empty = {.num_values = 0};
+  skin_node_t keep_root = {.child = &values, .arg = &keep_rest, .op = SKINOP_FILTER};
+  skin_node_t drop_root = {.child = &values, .arg = &drop_rest, .op = SKINOP_FILTER};
+  skin_node_t empty_root = {.child = &values, .arg = &empty, .op = SKINOP_FILTER};
+  node_evaluate(&keep_root);
+  node_evaluate(&drop_root);
+  node_evaluate(&empty_root);
+
+  // the last mask value is extended over the rest of the values
+  ASSERT_EQ(keep_root.num_values, 5);
+  ASSERT_FLOAT_EQ(keep_root.values[0], 2.0f);
+  ASSERT_FLOAT_EQ(keep_root.values[4], 6.0f);
+  ASSERT_EQ(drop_root.num_values, 1);
+  ASSERT_FLOAT_EQ(drop_root.values[0], 1.0f);
+  // an empty mask leaves the values alone like every other binary operator
+  ASSERT_EQ(empty_root.num_values, 6);
+  return 0;
+}
+
+TEST(node_evaluator, reduce_evaluate) {
+  skin_node_t child = {.num_values = 21};
+  for (int i = 0; i < 21; i++) {
+    child.values[i] = (i % 5) - 2.0f;
+  }
+  child.values[13] = 40;
+  child.values[17] = -9;
+  skin_node_t sum = {.child = &child, .op = SKINOP_SUM};
+  skin_node_t count = {.child = &child, .op = SKINOP_COUNT};
+  skin_node_t min = {.child = &child, .op = SKINOP_REDUCE_MIN};
+  skin_node_t max = {.child = &child, .op = SKINOP_REDUCE_MAX};
+  node_evaluate(&sum);
+  node_evaluate(&count);
+  node_evaluate(&min);
+  node_evaluate(&max);
+  print_node_tree_verbose(&sum, 0);
+
+  float expected_sum = 0;
+  int expected_count = 0;
+  for (int i = 0; i < 21; i++) {
+    expected_sum += child.values[i];
+    expected_count += child.values[i] != 0;
+  }
+  ASSERT_EQ(sum.num_values, 1);
+  ASSERT_FLOAT_EQ(sum.values[0], expected_sum);
+  ASSERT_EQ(count.num_values, 1);
+  ASSERT_FLOAT_EQ(count.values[0], (float)expected_count);
+  ASSERT_EQ(min.num_values, 1);
+  ASSERT_FLOAT_EQ(min.values[0], -9.0f);
+  ASSERT_EQ(max.num_values, 1);
+  ASSERT_FLOAT_EQ(max.values[0], 40.0f);
+
+  // reducing nothing gives 0 for sum and count but no value at all for min and max
+  child.num_values = 0;
+  node_evaluate(&sum);
+  node_evaluate(&count);
+  node_evaluate(&min);
+  ASSERT_EQ(sum.num_values, 1);
+  ASSERT_FLOAT_EQ(sum.values[0], 0.0f);
+  ASSERT_EQ(count.num_values, 1);
+  ASSERT_FLOAT_EQ(count.values[0], 0.0f);
+  ASSERT_EQ(min.num_values, 0);
+  return 0;
+}
+
+TEST(node_evaluator, scan_evaluate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  // offsets of variable width bars laid out end to end
+  skin_node_t* node = expression_parse(sk, "_scan(example_size) - example_size");
+  ASSERT(node != NULL);
+  example_size.node->num_values = 39;
+  for (int i = 0; i < 39; i++) {
+    example_size.node->values[i] = (i % 4) + 1;
+  }
+  node_evaluate(node);
+  print_node_tree_verbose(node, 0);
+
+  ASSERT_EQ(node->num_values, 39);
+  float offset = 0;
+  for (int i = 0; i < 39; i++) {
+    ASSERT_FLOAT_EQ(node->values[i], offset);
+    offset += (i % 4) + 1;
+  }
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(node_evaluator, select_evaluate) {
+  skin_node_t cond = {.values = {1, 0, 0, 1, 1}, .num_values = 5};
+  skin_node_t a = {.values = {10, 20, 30}, .num_values = 3};
+  skin_node_t b_child = {.values = {7}, .num_values = 1};
+  skin_node_t b = {.child = &b_child, .op = SKINOP_NEGATE};
+  skin_node_t root = {.child = &cond, .arg = &a, .arg2 = &b, .op = SKINOP_SELECT};
+  node_evaluate(&root);
+  print_node_tree_verbose(&root, 0);
+
+  ASSERT_EQ(root.num_values, 5);
+  ASSERT_FLOAT_EQ(root.values[0], 10.0f);
+  ASSERT_FLOAT_EQ(root.values[1], -7.0f);
+  ASSERT_FLOAT_EQ(root.values[2], -7.0f);
+  ASSERT_FLOAT_EQ(root.values[3], 30.0f);
+  ASSERT_FLOAT_EQ(root.values[4], 30.0f);
+
+  // when every value picks a the b branch is never evaluated
+  b.num_values = 0;
+  for (int i = 0; i < 5; i++) {
+    cond.values[i] = 1;
+  }
+  node_evaluate(&root);
+  ASSERT_EQ(b.num_values, 0);
+  ASSERT_FLOAT_EQ(root.values[1], 20.0f);
+
+  // an empty branch reads as 0
+  a.num_values = 0;
+  node_evaluate(&root);
+  ASSERT_EQ(root.num_values, 5);
+  ASSERT_FLOAT_EQ(root.values[2], 0.0f);
+  return 0;
+}
+
+TEST(node_evaluator, lerp_evaluate) {
+  skin_node_t a = {.values = {0, 10, 20, 30}, .num_values = 4};
+  skin_node_t b = {.values = {10, 20}, .num_values = 2};
+  skin_node_t t = {.values = {0.5f, 0, 1}, .num_values = 3};
+  skin_node_t root = {.child = &a, .arg = &b, .arg2 = &t, .op = SKINOP_LERP};
+  node_evaluate(&root);
+  print_node_tree_verbose(&root, 0);
+
+  ASSERT_EQ(root.num_values, 4);
+  ASSERT_FLOAT_EQ(root.values[0], 5.0f);
+  ASSERT_FLOAT_EQ(root.values[1], 10.0f);
+  ASSERT_FLOAT_EQ(root.values[2], 20.0f);
+  ASSERT_FLOAT_EQ(root.values[3], 20.0f);
+
+  t.num_values = 0;
+  node_evaluate(&root);
+  ASSERT_FLOAT_EQ(root.values[0], 0.0f);
+  ASSERT_FLOAT_EQ(root.values[3], 30.0f);
+  return 0;
+}
+
+TEST(node_evaluator, mask_evaluate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  example_x.node->num_values = 70;
+  example_size.node->num_values = 45;
+  for (int i = 0; i < 70; i++) {
+    example_x.node->values[i] = (i * 7) % 11;
+    example_size.node->values[i] = (i * 3) % 5 + 2;
+  }
+
+  // comparisons feeding mask consumers stay as bits inside the tree
+  skin_node_t* compare = expression_parse(sk, "example_x < example_size");
+  skin_node_t* product = expression_parse(sk, "example_x * (example_x < example_size)");
+  skin_node_t* filter = expression_parse(sk, "_filter(example_x, (example_x < example_size))");
+  skin_node_t* select = expression_parse(sk, "_select((example_x < example_size), 1, -1)");
+  skin_node_t* count = expression_parse(sk, "_count((example_x < example_size))");
+  node_evaluate(product);
+  node_evaluate(filter);
+  node_evaluate(select);
+  node_evaluate(count);
+  ASSERT_EQ(product->arg->type, SKINTYPE_MASK);
+  ASSERT(!product->arg->mask_expanded);
+
+  // the root of an evaluation is always left as floats
+  node_evaluate(compare);
+  ASSERT_EQ(compare->num_values, 70);
+
+  int kept = 0;
+  for (int i = 0; i < 70; i++) {
+    float x = example_x.node->values[i];
+    // past the end of size its last value is extended
+    float size = example_size.node->values[MIN(i, 44)];
+    bool less = x < size;
+    ASSERT_FLOAT_EQ(compare->values[i], (less ? 1.0f : 0.0f));
+    ASSERT_FLOAT_EQ(product->values[i], (less ? x : 0.0f));
+    ASSERT_FLOAT_EQ(select->values[i], (less ? 1.0f : -1.0f));
+    if (less) {
+      ASSERT_FLOAT_EQ(filter->values[kept], x);
+      kept++;
+    }
+  }
+  ASSERT_EQ(filter->num_values, kept);
+  ASSERT_FLOAT_EQ(count->values[0], (float)kept);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(node_evaluator, vector_evaluate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  float pos[] = {1, 2, 3, 4, 5, 6};
+  memcpy(example2_pos.node->values, pos, sizeof(pos));
+  example2_pos.node->num_values = 6;
+  example_x.node->values[0] = 10;
+  example_x.node->values[1] = 20;
+  example_x.node->num_values = 2;
+
+  skin_node_t* scaled = expression_parse(sk, "example2_pos * 100");
+  skin_node_t* offset = expression_parse(sk, "example2_pos + _pack(1, -1)");
+  skin_node_t* per_element = expression_parse(sk, "example2_pos * example_x");
+  skin_node_t* packed = expression_parse(sk, "_pack(example_x, 0.5)");
+  skin_node_t* sum = expression_parse(sk, "_sum(example2_pos)");
+  ASSERT_EQ(scaled->width, 2);
+  ASSERT_EQ(packed->width, 2);
+  node_evaluate(scaled);
+  node_evaluate(offset);
+  node_evaluate(per_element);
+  node_evaluate(packed);
+  node_evaluate(sum);
+
+  ASSERT_EQ(scaled->num_values, 6);
+  ASSERT_FLOAT_EQ(scaled->values[3], 400.0f);
+  ASSERT_FLOAT_EQ(offset->values[4], 6.0f);
+  ASSERT_FLOAT_EQ(offset->values[5], 5.0f);
+  // a scalar applies to both components of its element and its last value is extended
+  ASSERT_FLOAT_EQ(per_element->values[0], 10.0f);
+  ASSERT_FLOAT_EQ(per_element->values[1], 20.0f);
+  ASSERT_FLOAT_EQ(per_element->values[2], 60.0f);
+  ASSERT_FLOAT_EQ(per_element->values[5], 120.0f);
+  ASSERT_EQ(packed->num_values, 4);
+  ASSERT_FLOAT_EQ(packed->values[2], 20.0f);
+  ASSERT_FLOAT_EQ(packed->values[3], 0.5f);
+  // reductions work per component
+  ASSERT_EQ(sum->num_values, 2);
+  ASSERT_FLOAT_EQ(sum->values[0], 9.0f);
+  ASSERT_FLOAT_EQ(sum->values[1], 12.0f);
+
+  // vectors of different widths can't be combined
+  ASSERT(expression_parse(sk, "_pack(example2_pos, example2_pos) + example2_pos") == NULL);
+  ASSERT(expression_parse(sk, "_filter(example_x, example2_pos)") == NULL);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(node_evaluator, stateful_evaluate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_node_t* smooth = expression_parse(sk, "_smooth(example_x, 10)");
+  skin_node_t* spring = expression_parse(sk, "_spring(example_x, 100, 20)");
+  skin_node_t* delay = expression_parse(sk, "_delay(example_x, 2)");
+  skin_node_t* ddt = expression_parse(sk, "_ddt(example_x)");
+  ASSERT(smooth != NULL && spring != NULL && delay != NULL && ddt != NULL);
+
+  example_x.node->num_values = 1;
+  for (int frame = 0; frame < 200; frame++) {
+    sk->clock.frame++;
+    sk->clock.delta = 0.1f;
+    sk->clock.time += 0.1f;
+    example_x.node->values[0] = frame;
+    node_evaluate(smooth);
+    node_evaluate(spring);
+    node_evaluate(delay);
+    node_evaluate(ddt);
+    if (frame == 0) {
+      // new values start out settled
+      ASSERT_FLOAT_EQ(smooth->values[0], 0.0f);
+      ASSERT_FLOAT_EQ(ddt->values[0], 0.0f);
+      ASSERT_FLOAT_EQ(delay->values[0], 0.0f);
+    }
+    if (frame == 1) {
+      ASSERT(fabsf(smooth->values[0] - (1.0f - expf(-1.0f))) < 1e-5);
+    }
+    if (frame >= 2) {
+      ASSERT_FLOAT_EQ(delay->values[0], (float)(frame - 2));
+      ASSERT(fabsf(ddt->values[0] - 10.0f) < 1e-3);
+    }
+  }
+  // a steady ramp of 1 per frame is followed with a constant lag of (1 - f) / f
+  float f = 1.0f - expf(-1.0f);
+  ASSERT(fabsf(smooth->values[0] - (199.0f - (1.0f - f) / f)) < 1e-3);
+  // state is sized to the input, not to MAX_VALUES
+  ASSERT(smooth->state_size < MAX_VALUES);
+  ASSERT(spring->state_size < MAX_VALUES);
+
+  // evaluating again in the same frame doesn't step the state
+  example_x.node->values[0] = 1000;
+  float before = spring->values[0];
+  node_evaluate(spring);
+  ASSERT_FLOAT_EQ(spring->values[0], before);
+
+  // growing the input keeps the state of the values that were already there
+  float lagging = smooth->values[0];
+  for (int i = 1; i < 300; i++) {
+    example_x.node->values[i] = 199;
+  }
+  example_x.node->num_values = 300;
+  sk->clock.frame++;
+  sk->clock.time += 0.1f;
+  node_evaluate(smooth);
+  ASSERT(smooth->state_size >= 300);
+  ASSERT(fabsf(smooth->values[0] - (lagging + (1000.0f - lagging) * f)) < 1e-3);
+  ASSERT_FLOAT_EQ(smooth->values[299], 199.0f);
+
+  // the spring settles on a target that stops moving
+  for (int frame = 0; frame < 100; frame++) {
+    sk->clock.frame++;
+    sk->clock.time += 0.1f;
+    node_evaluate(spring);
+  }
+  ASSERT(fabsf(spring->values[0] - 1000.0f) < 0.01f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(node_evaluator, random_evaluate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  for (int i = 0; i < 1000; i++) {
+    example_x.node->values[i] = i;
+  }
+  example_x.node->num_values = 1000;
+
+  skin_node_t* r = expression_parse(sk, "_rand(7, example_x)");
+  skin_node_t* same = expression_parse(sk, "_rand(7, example_x)");
+  skin_node_t* other = expression_parse(sk, "_rand(8, example_x)");
+  skin_node_t* noise = expression_parse(sk, "_noise((example_x * 0.01), 3.5)");
+  node_evaluate(r);
+  node_evaluate(same);
+  node_evaluate(other);
+  node_evaluate(noise);
+
+  // as long as the longer argument, the same inputs always give the same values
+  ASSERT_EQ(r->num_values, 1000);
+  ASSERT_EQ(noise->num_values, 1000);
+  float mean = 0;
+  int num_same = 0;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT(r->values[i] >= 0.0f && r->values[i] < 1.0f);
+    ASSERT_FLOAT_EQ(r->values[i], same->values[i]);
+    num_same += r->values[i] == other->values[i];
+    mean += r->values[i] / 1000;
+  }
+  ASSERT(num_same < 5);
+  ASSERT(fabsf(mean - 0.5f) < 0.05f);
+
+  // value noise is continuous, a step of 0.01 never jumps by more than the slope of the blend
+  for (int i = 0; i < 1000; i++) {
+    ASSERT(noise->values[i] >= 0.0f && noise->values[i] <= 1.0f);
+    if (i > 0) {
+      ASSERT(fabsf(noise->values[i] - noise->values[i - 1]) < 0.02f);
+    }
+  }
+
+  // seeds that compare equal give the same values
+  float zeros[2] = {0.0f, -0.0f};
+  float index[2] = {3.0f, 3.0f};
+  float out[4];
+  noise_rand(out, zeros, index, 2);
+  ASSERT_FLOAT_EQ(out[0], out[1]);
+  // any float is a valid coordinate, huge ones and NaN included
+  float coords[4] = {3e9f, -3e9f, NAN, 1e38f};
+  noise_value(out, coords, coords, 4);
+  for (int i = 0; i < 4; i++) {
+    ASSERT(out[i] >= 0.0f && out[i] <= 1.0f);
+  }
+
+  skin_deinit(sk);
+  return 0;
+}
+
+// a skin evaluated over and over on its own thread, mismatches counts the evaluations that did
+// not give the values it gave on its own
+typedef struct parallel_eval {
+  skin_node_t* node;
+  float expected[MAX_VALUES];
+  int mismatches;
+} parallel_eval_t;
+
+static void* parallel_eval_run(void* user) {
+  parallel_eval_t* eval = (parallel_eval_t*)user;
+  for (int run = 0; run < 2000; run++) {
+    node_evaluate(eval->node);
+    for (int i = 0; i < eval->node->num_values; i++) {
+      if (eval->node->values[i] != eval->expected[i]) {
+        eval->mismatches++;
+        break;
+      }
+    }
+  }
+  return NULL;
+}
+
+TEST(node_evaluator, parallel_skins) {
+  // rand, noise and vector operands are widened into scratch memory, two skins evaluated at the
+  // same time must not share it
+  const char* expressions[2] = {"_rand(7, example_x) + _noise(example_x, 0.5)",
+                                "_pack(example_x, 2) * _pack(_rand(8, example_x), 3)"};
+  skin_t* skins[2];
+  static parallel_eval_t evals[2];
+  for (int s = 0; s < 2; s++) {
+    skin_init(&skins[s], inputs, 2);
+    for (int i = 0; i < 1000; i++) {
+      example_x.node->values[i] = i * (s + 1);
+    }
+    example_x.node->num_values = 1000;
+    evals[s].node = expression_parse(skins[s], expressions[s]);
+    ASSERT(evals[s].node != NULL);
+    node_evaluate(evals[s].node);
+    memcpy(evals[s].expected, evals[s].node->values, sizeof(float) * evals[s].node->num_values);
+    evals[s].mismatches = 0;
+  }
+
+  pthread_t threads[2];
+  for (int s = 0; s < 2; s++) {
+    ASSERT_EQ(pthread_create(&threads[s], NULL, parallel_eval_run, &evals[s]), 0);
+  }
+  for (int s = 0; s < 2; s++) {
+    pthread_join(threads[s], NULL);
+  }
+  ASSERT_EQ(evals[0].mismatches, 0);
+  ASSERT_EQ(evals[1].mismatches, 0);
+
+  skin_deinit(skins[0]);
+  skin_deinit(skins[1]);
+  return 0;
+}
+
+SUITE(animation);
+
+TEST(animation, trigger_animation) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_animation_t* anim = skin_add_animation(sk, "jump", 1.0f, "JUMP");
+  ASSERT(anim != NULL);
+  int event = skin_find_event(sk, "JUMP");
+  ASSERT_EQ(event, 0);
+  ASSERT_EQ(anim->node->num_values, 0);
+
+  skin_trigger_event(sk, event);
+  skin_draw(sk, 0.25f);
+  ASSERT_EQ(anim->node->num_values, 1);
+  ASSERT_FLOAT_EQ(anim->node->values[0], 0.25f);
+
+  skin_draw(sk, 0.5f);
+  ASSERT_EQ(anim->node->num_values, 1);
+  ASSERT_FLOAT_EQ(anim->node->values[0], 0.75f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(animation, multiple_instances) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_animation_t* anim = skin_add_animation(sk, "jump", 1.0f, "JUMP");
+  int event = skin_find_event(sk, "JUMP");
+
+  skin_trigger_event(sk, event);
+  skin_draw(sk, 0.5f);
+  skin_trigger_event(sk, event);
+  skin_draw(sk, 0.25f);
+  ASSERT_EQ(anim->node->num_values, 2);
+  ASSERT_FLOAT_EQ(anim->node->values[0], 0.75f);
+  ASSERT_FLOAT_EQ(anim->node->values[1], 0.25f);
+
+  // first instance expires, second keeps going
+  skin_draw(sk, 0.5f);
+  ASSERT_EQ(anim->node->num_values, 1);
+  ASSERT_FLOAT_EQ(anim->node->values[0], 0.75f);
+
+  skin_draw(sk, 0.5f);
+  ASSERT_EQ(anim->node->num_values, 0);
+  ASSERT_EQ(sk->num_active_animations, 0);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(animation, shared_event) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_animation_t* a = skin_add_animation(sk, "short", 0.5f, "JUMP");
+  skin_animation_t* b = skin_add_animation(sk, "long", 10.0f, "JUMP");
+  skin_animation_t* idle = skin_add_animation(sk, "idle", 1.0f, "LAND");
+
+  skin_trigger_event(sk, skin_find_event(sk, "JUMP"));
+  skin_draw(sk, 0.25f);
+  ASSERT_EQ(sk->num_active_animations, 2);
+  ASSERT_FLOAT_EQ(a->node->values[0], 0.5f);
+  ASSERT_FLOAT_EQ(b->node->values[0], 0.025f);
+  ASSERT_EQ(idle->node->num_values, 0);
+
+  // long gaps between frames still expire through the higher levels of the wheel
+  skin_draw(sk, 9.0f);
+  ASSERT_EQ(a->node->num_values, 0);
+  ASSERT_EQ(b->node->num_values, 1);
+  skin_draw(sk, 1.0f);
+  ASSERT_EQ(b->node->num_values, 0);
+  ASSERT_EQ(sk->num_active_animations, 0);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(animation, long_uptime) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_animation_t* a = skin_add_animation(sk, "blink", 0.5f, "BLINK");
+  skin_animation_t* b = skin_add_animation(sk, "fade", 3600.0f, "BLINK");
+
+  // a paused skin comes back after 60 days, past 2^32 ticks of the wheel
+  skin_trigger_event(sk, skin_find_event(sk, "BLINK"));
+  skin_draw(sk, 0.1f);
+  skin_draw(sk, 60.0f * 24 * 3600);
+  ASSERT_EQ(sk->num_active_animations, 0);
+  ASSERT(sk->timer_wheel.now > 0xffffffffull);
+
+  // timers keep working from there, both short and through the higher levels
+  skin_trigger_event(sk, skin_find_event(sk, "BLINK"));
+  skin_draw(sk, 0.25f);
+  ASSERT_FLOAT_EQ(a->node->values[0], 0.5f);
+  skin_draw(sk, 0.3f);
+  ASSERT_EQ(a->node->num_values, 0);
+  ASSERT_EQ(b->node->num_values, 1);
+  skin_draw(sk, 3599.0f);
+  ASSERT_EQ(b->node->num_values, 1);
+  skin_draw(sk, 1.0f);
+  ASSERT_EQ(b->node->num_values, 0);
+  ASSERT_EQ(sk->num_active_animations, 0);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(animation, animation_expression) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_add_animation(sk, "jump", 2.0f, "JUMP");
+  skin_node_t* node = expression_parse(sk, "jump * 100");
+  ASSERT(node != NULL);
+
+  skin_trigger_event(sk, skin_find_event(sk, "JUMP"));
+  skin_draw(sk, 0.5f);
+  node_evaluate(node);
+  ASSERT_EQ(node->num_values, 1);
+  ASSERT_FLOAT_EQ(node->values[0], 25.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+SUITE(draw);
+
+TEST(draw, emit_item) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  float pos[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  memcpy(example2_pos.node->values, pos, sizeof(pos));
+  example2_pos.node->num_values = 10;
+  example_size.node->values[0] = 8;
+  example_size.node->values[1] = 16;
+  example_size.node->num_values = 2;
+  example_x.node->num_values = 0;
+
+  skin_layer_t* layer = skin_add_layer(sk, "layer");
+  skin_item_t* item = skin_add_item(sk, layer, "blocks");
+  skin_item_set_field(sk, item, SKINFIELD_X, "example2_pos");
+  skin_item_set_field(sk, item, SKINFIELD_W, "example_size");
+  skin_item_set_field(sk, item, SKINFIELD_H, "example_x");
+  skin_item_set_field(sk, item, SKINFIELD_A, "0.5");
+  skin_draw(sk, 0.1f);
+
+  draw_instance_t instances[8];
+  ASSERT_EQ(draw_emit_item(item, sk->draw_scratch, instances, 8), 5);
+  // vector fields are read with their stride, short fields extend and empty ones are 0
+  ASSERT_FLOAT_EQ(instances[4].x, 9.0f);
+  ASSERT_FLOAT_EQ(instances[4].y, 10.0f);
+  ASSERT_FLOAT_EQ(instances[0].w, 8.0f);
+  ASSERT_FLOAT_EQ(instances[4].w, 16.0f);
+  ASSERT_FLOAT_EQ(instances[3].h, 0.0f);
+  ASSERT_FLOAT_EQ(instances[2].src_w, 1.0f);
+  // colour that was never set is white, alpha 0.5 rounds to 128
+  ASSERT_EQ(instances[4].rgba, 0x80ffffffu);
+  ASSERT_EQ(draw_emit_item(item, sk->draw_scratch, instances, 3), 3);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(draw, command_list) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+  draw_recorder_t recorder;
+  memset(&recorder, 0, sizeof(recorder));
+  skin_set_backend(sk, draw_record, &recorder);
+
+  example_x.node->values[0] = 1;
+  example_x.node->values[1] = 2;
+  example_x.node->values[2] = 3;
+  example_x.node->num_values = 3;
+
+  skin_layer_t* background = skin_add_layer(sk, "background");
+  background->shader = 7;
+  skin_item_t* a = skin_add_item(sk, background, "a");
+  skin_item_t* b = skin_add_item(sk, background, "b");
+  skin_item_t* c = skin_add_item(sk, background, "c");
+  a->texture = 1;
+  b->texture = 1;
+  c->texture = 2;
+  skin_item_set_field(sk, a, SKINFIELD_X, "example_x");
+  skin_item_set_field(sk, b, SKINFIELD_X, "example_x * 2");
+  skin_item_set_field(sk, c, SKINFIELD_X, "5");
+  skin_layer_t* hud = skin_add_layer(sk, "hud");
+  skin_item_t* empty = skin_add_item(sk, hud, "empty");
+  skin_item_t* d = skin_add_item(sk, hud, "d");
+  d->texture = 2;
+  skin_item_set_field(sk, empty, SKINFIELD_X, "example_size");
+  skin_item_set_field(sk, d, SKINFIELD_X, "6");
+  example_size.node->num_values = 0;
+
+  skin_draw(sk, 0.1f);
+  ASSERT_EQ(recorder.frames, 1);
+  const draw_list_t* list = recorder.last;
+  // items with the same texture share one quads command, empty items add nothing and state that
+  // is already set carries over into the next layer
+  ASSERT_EQ(list->num_commands, 8);
+  ASSERT_EQ(list->commands[0].type, DRAWCMD_SET_LAYER);
+  ASSERT_EQ(list->commands[1].type, DRAWCMD_SET_SHADER);
+  ASSERT_EQ(list->commands[1].handle, 7);
+  ASSERT_EQ(list->commands[2].type, DRAWCMD_SET_TEXTURE);
+  ASSERT_EQ(list->commands[3].type, DRAWCMD_QUADS);
+  ASSERT_EQ(list->commands[3].count, 6);
+  ASSERT_EQ(list->commands[4].handle, 2);
+  ASSERT_EQ(list->commands[5].first, 6);
+  ASSERT_EQ(list->commands[6].type, DRAWCMD_SET_LAYER);
+  ASSERT_EQ(list->commands[6].handle, 1);
+  ASSERT_EQ(list->commands[7].type, DRAWCMD_QUADS);
+  ASSERT_FLOAT_EQ(list->instances[5].x, 6.0f);
+
+  skin_draw(sk, 0.1f);
+  ASSERT_EQ(recorder.frames, 2);
+  ASSERT_EQ(recorder.commands[DRAWCMD_QUADS], 6);
+  ASSERT_EQ(recorder.instances, 16);
+
+  draw_list_t* extra = sk->draw_list;
+  float line[] = {0, 0, 10, 10};
+  draw_list_primitive(extra, DRAWPRIM_LINE_LOOP, line, 2, 0xffffffffu);
+  draw_list_text(extra, 0, "score", 16, 4, 4, 0xff0000ffu);
+  ASSERT_EQ(extra->commands[9].count, 5);
+  ASSERT(memcmp(&extra->chars[extra->commands[9].first], "score", 5) == 0);
+  ASSERT(!extra->overflowed);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(draw, sorted_layers) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+  draw_recorder_t recorder;
+  memset(&recorder, 0, sizeof(recorder));
+  skin_set_backend(sk, draw_record, &recorder);
+
+  // the same items in a layer that keeps its order and one that can be sorted
+  skin_layer_t* ordered = skin_add_layer(sk, "ordered");
+  skin_layer_t* sorted = skin_add_layer(sk, "sorted");
+  sorted->sort_items = true;
+  for (int i = 0; i < 8; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "item%d", i);
+    skin_item_t* a = skin_add_item(sk, ordered, name);
+    skin_item_t* b = skin_add_item(sk, sorted, name);
+    // handles that only differ above the low 16 bits still sort apart
+    a->texture = b->texture = 1 + (i % 2) * 0x10000;
+    a->blend = b->blend = i >= 6 ? SKINBLEND_ADD : SKINBLEND_ALPHA;
+    skin_item_set_field(sk, a, SKINFIELD_X, "1");
+    snprintf(name, sizeof(name), "%d", i);
+    skin_item_set_field(sk, b, SKINFIELD_X, name);
+  }
+  skin_draw(sk, 0.1f);
+
+  int textures[2] = {0};
+  int blends[2] = {0};
+  int layer = -1;
+  for (int i = 0; i < recorder.last->num_commands; i++) {
+    const draw_command_t* cmd = &recorder.last->commands[i];
+    if (cmd->type == DRAWCMD_SET_LAYER) {
+      layer = cmd->handle;
+    } else if (cmd->type == DRAWCMD_SET_TEXTURE) {
+      textures[layer]++;
+    } else if (cmd->type == DRAWCMD_SET_BLEND) {
+      blends[layer]++;
+    }
+  }
+  ASSERT_EQ(textures[0], 8);
+  ASSERT_EQ(blends[0], 1);
+  // texture 1 alpha, texture 1 add, texture 2 alpha, texture 2 add, starting from the add left
+  // over by the first layer
+  ASSERT_EQ(textures[1], 2);
+  ASSERT_EQ(blends[1], 4);
+  // items that share state keep the order they were added in
+  const draw_instance_t* instances = recorder.last->instances;
+  ASSERT_FLOAT_EQ(instances[8].x, 0.0f);
+  ASSERT_FLOAT_EQ(instances[9].x, 2.0f);
+  ASSERT_FLOAT_EQ(instances[10].x, 4.0f);
+  ASSERT_FLOAT_EQ(instances[11].x, 6.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(draw, expand_quads) {
+  draw_instance_t instances[5];
+  for (int i = 0; i < 5; i++) {
+    draw_instance_t d = {10.0f * i, 20, 4, 8, 0.25f, 0.5f, 0.5f, 0.75f, 0x11223344u + i};
+    instances[i] = d;
+  }
+  draw_vertex_t vertices[20];
+  ASSERT_EQ(sizeof(draw_vertex_t), 16);
+  draw_expand_quads(vertices, instances, 5);
+  // both the 4 wide and the leftover instance produce the same corners
+  for (int i = 0; i < 5; i += 4) {
+    const draw_vertex_t* v = &vertices[i * 4];
+    ASSERT_FLOAT_EQ(v[0].x, (10.0f * i));
+    ASSERT_FLOAT_EQ(v[0].y, 20.0f);
+    ASSERT_FLOAT_EQ(v[1].y, 28.0f);
+    ASSERT_FLOAT_EQ(v[2].x, (10.0f * i + 4));
+    ASSERT_FLOAT_EQ(v[3].y, 20.0f);
+    ASSERT_EQ(v[0].u, 16384);
+    ASSERT_EQ(v[0].v, 32768);
+    ASSERT_EQ(v[2].u, 49151);
+    // past 1 clamps to the edge of the texture
+    ASSERT_EQ(v[1].v, 65535);
+    ASSERT_EQ(v[3].rgba, 0x11223344u + i);
+  }
+  return 0;
+}
+
+static const char* glyph_text(const uint8_t* glyphs, int n) {
+  static char text[DRAW_NUMBER_MAX_GLYPHS + 1];
+  for (int i = 0; i < n; i++) {
+    text[i] = glyphs[i] + DRAW_FIRST_GLYPH;
+  }
+  text[n] = '\0';
+  return text;
+}
+
+TEST(draw, number_glyphs) {
+  uint8_t glyphs[DRAW_NUMBER_MAX_GLYPHS];
+  skin_number_format_t plain = {0, 0, false};
+  skin_number_format_t money = {1, 2, true};
+  skin_number_format_t padded = {5, 0, false};
+  int n = draw_number_glyphs(0.0f, &plain, glyphs);
+  ASSERT_STRING_EQ(glyph_text(glyphs, n), "0");
+  n = draw_number_glyphs(1234567.5f, &plain, glyphs);
+  ASSERT_STRING_EQ(glyph_text(glyphs, n), "1234568");
+  n = draw_number_glyphs(1234567.5f, &money, glyphs);
+  ASSERT_STRING_EQ(glyph_text(glyphs, n), "1,234,567.50");
+  n = draw_number_glyphs(0.125f, &money, glyphs);
+  ASSERT_STRING_EQ(glyph_text(glyphs, n), "0.13");
+  // rounds to zero so there is no sign
+  n = draw_number_glyphs(-0.001f, &money, glyphs);
+  ASSERT_STRING_EQ(glyph_text(glyphs, n), "0.00");
+  n = draw_number_glyphs(-42.0f, &padded, glyphs);
+  ASSERT_STRING_EQ(glyph_text(glyphs, n), "-00042");
+  n = draw_number_glyphs(1e30f, &money, glyphs);
+  ASSERT(n <= DRAW_NUMBER_MAX_GLYPHS);
+  return 0;
+}
+
+TEST(draw, number_item) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+  draw_recorder_t recorder;
+  memset(&recorder, 0, sizeof(recorder));
+  skin_set_backend(sk, draw_record, &recorder);
+
+  skin_layer_t* hud = skin_add_layer(sk, "hud");
+  skin_item_t* score = skin_add_item(sk, hud, "score");
+  skin_number_format_t format = {3, 0, true};
+  skin_item_set_number(score, 2, &format);
+  skin_item_set_field(sk, score, SKINFIELD_X, "example_size");
+  skin_item_set_field(sk, score, SKINFIELD_H, "24");
+  skin_item_set_field(sk, score, SKINFIELD_VALUE, "example_x");
+  example_size.node->values[0] = 10;
+  example_size.node->values[1] = 200;
+  example_size.node->num_values = 2;
+  example_x.node->values[0] = 7;
+  example_x.node->values[1] = 12345;
+  example_x.node->num_values = 2;
+
+  skin_draw(sk, 0.1f);
+  const draw_list_t* list = recorder.last;
+  ASSERT_EQ(recorder.commands[DRAWCMD_GLYPHS], 2);
+  ASSERT_EQ(recorder.commands[DRAWCMD_SET_TEXTURE], 0);
+  const draw_command_t* second = &list->commands[list->num_commands - 1];
+  ASSERT_EQ(second->type, DRAWCMD_GLYPHS);
+  ASSERT_EQ(second->handle, 2);
+  ASSERT_FLOAT_EQ(second->x, 200.0f);
+  ASSERT_FLOAT_EQ(second->line_height, 24.0f);
+  ASSERT_STRING_EQ(glyph_text(&list->glyphs[list->commands[list->num_commands - 2].first], 3), "007");
+  ASSERT_STRING_EQ(glyph_text(&list->glyphs[second->first], second->count), "12,345");
+  skin_deinit(sk);
+  return 0;
+}
+
+SUITE(particle);
+
+TEST(particle, emitter_spawn) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "effects");
+  skin_emitter_t* emitter = skin_add_emitter(sk, layer, "sparks", NULL);
+  ASSERT(emitter != NULL);
+  ASSERT_EQ(skin_emitter_set(sk, emitter, SKINEMIT_RATE, "10"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_emitter_set(sk, emitter, SKINEMIT_LIFE, "1"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_emitter_set(sk, emitter, SKINEMIT_X, "sparks_spawn * 10"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_emitter_set(sk, emitter, SKINEMIT_VY, "2"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_emitter_set(sk, emitter, SKINEMIT_AY, "-4"), SKINERR_SUCCESS);
+  skin_item_t* item = &sk->items[emitter->item];
+
+  // 10 per second spawns 2.5 particles over a quarter second, the half carries over
+  skin_draw(sk, 0.25f);
+  ASSERT_EQ(emitter->num_particles, 2);
+  ASSERT_EQ(item->num_values[SKINFIELD_X], 2);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][1], 10.0f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_A][1], 1.0f);
+  skin_draw(sk, 0.25f);
+  ASSERT_EQ(emitter->num_particles, 5);
+  skin_node_t* y = emitter->particles[SKINPARTICLE_Y];
+  skin_node_t* vy = emitter->particles[SKINPARTICLE_VY];
+  ASSERT_FLOAT_EQ(vy->values[0], 1.0f);
+  ASSERT_FLOAT_EQ(y->values[0], 0.25f);
+  ASSERT_FLOAT_EQ(emitter->particles[SKINPARTICLE_AGE]->values[0], 0.25f);
+
+  // the first particles die and are replaced by the last ones
+  skin_draw(sk, 0.5f);
+  ASSERT_EQ(emitter->num_particles, 10);
+  skin_draw(sk, 0.3f);
+  ASSERT_EQ(emitter->num_particles, 11);
+  skin_node_t* age = emitter->particles[SKINPARTICLE_AGE];
+  for (int i = 0; i < emitter->num_particles; i++) {
+    ASSERT(age->values[i] < 1.0f);
+  }
+  ASSERT_FLOAT_EQ(emitter->particles[SKINPARTICLE_X]->values[0], 90.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(particle, emitter_burst) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "effects");
+  skin_emitter_t* emitter = skin_add_emitter(sk, layer, "hit", "HIT");
+  skin_emitter_set(sk, emitter, SKINEMIT_BURST, "3");
+  skin_emitter_set(sk, emitter, SKINEMIT_VX, "_rand(1, hit_spawn)");
+  skin_emitter_set(sk, emitter, SKINEMIT_R, "0.5");
+  ASSERT_EQ(skin_emitter_set(sk, emitter, SKINEMIT_X, "example2_pos"), SKINERR_EXPRESSION_ERROR);
+  skin_node_t* moving = expression_parse(sk, "_count((hit_vx > 0.0001))");
+
+  skin_draw(sk, 0.1f);
+  ASSERT_EQ(emitter->num_particles, 0);
+  skin_trigger_event(sk, skin_find_event(sk, "HIT"));
+  skin_trigger_event(sk, skin_find_event(sk, "HIT"));
+  skin_draw(sk, 0.1f);
+  ASSERT_EQ(emitter->num_particles, 6);
+  ASSERT_EQ(emitter->spawn->num_values, 6);
+  ASSERT_FLOAT_EQ(emitter->spawn->values[5], 5.0f);
+  ASSERT_FLOAT_EQ(emitter->particles[SKINPARTICLE_R]->values[2], 0.5f);
+
+  // the particle arrays can be read by any expression
+  node_evaluate(moving);
+  ASSERT_FLOAT_EQ(moving->values[0], 6.0f);
+  skin_draw(sk, 0.1f);
+  ASSERT_EQ(emitter->spawn->num_values, 0);
+  ASSERT_EQ(emitter->num_particles, 6);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(particle, fixed_tick_compact) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "effects");
+  skin_emitter_t* emitter = skin_add_emitter(sk, layer, "hit", "HIT");
+  skin_emitter_set(sk, emitter, SKINEMIT_BURST, "4");
+  skin_emitter_set(sk, emitter, SKINEMIT_LIFE, "hit_spawn + 0.25");
+  skin_emitter_set(sk, emitter, SKINEMIT_X, "hit_spawn * 10");
+  skin_emitter_set(sk, emitter, SKINEMIT_VX, "10");
+  skin_item_t* item = &sk->items[emitter->item];
+  skin_item_set_field(sk, item, SKINFIELD_W, "hit_x + 1");
+  skin_set_fixed_tick(sk, true);
+
+  skin_trigger_event(sk, skin_find_event(sk, "HIT"));
+  for (int tick = 0; tick < 4; tick++) {
+    skin_tick(sk, 0.1f);
+  }
+  // the first particle died on the last tick and the last one took its place
+  ASSERT_EQ(emitter->num_particles, 3);
+  ASSERT_FLOAT_EQ(emitter->particles[SKINPARTICLE_X]->values[0], 33.0f);
+
+  // the moved particle interpolates from where it was, not from the dead one
+  skin_draw(sk, 0.5f);
+  ASSERT_EQ(item->num_values[SKINFIELD_X], 3);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][0], 32.5f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][1], 12.5f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][2], 22.5f);
+  // fields computed from the particles can't follow the move and snap from the moved slot on
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_W][0], 34.0f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_W][1], 14.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+// particles the emitters below keep alive between them, the same load test/bench.c times
+#define MANY_PARTICLES 50000
+#define MANY_EMITTERS 13
+
+TEST(particle, many_emitters) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  // a second of life at this rate keeps each emitter a little under MAX_VALUES particles
+  char rate[16];
+  snprintf(rate, sizeof(rate), "%d", MANY_PARTICLES / MANY_EMITTERS + 1);
+  skin_layer_t* layer = skin_add_layer(sk, "effects");
+  for (int e = 0; e < MANY_EMITTERS; e++) {
+    char name[16];
+    snprintf(name, sizeof(name), "many%d", e);
+    skin_emitter_t* emitter = skin_add_emitter(sk, layer, name, NULL);
+    ASSERT(emitter != NULL);
+    skin_emitter_set(sk, emitter, SKINEMIT_RATE, rate);
+    skin_emitter_set(sk, emitter, SKINEMIT_LIFE, "1");
+  }
+
+  for (int frame = 0; frame < 90; frame++) {
+    particle_update(sk, 1.0f / 60.0f);
+  }
+  int total = 0;
+  for (int e = 0; e < sk->num_emitters; e++) {
+    ASSERT(sk->emitters[e].num_particles <= MAX_VALUES);
+    total += sk->emitters[e].num_particles;
+  }
+  ASSERT(total >= MANY_PARTICLES);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+SUITE(item);
+
+TEST(item, evaluate_fields) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "layer");
+  skin_item_t* item = skin_add_item(sk, layer, "item");
+  ASSERT_EQ(skin_item_set_field(sk, item, SKINFIELD_X, "example_x * 2"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_item_set_field(sk, item, SKINFIELD_W, "5"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_item_set_field(sk, item, SKINFIELD_Y, "1 + + 1"), SKINERR_EXPRESSION_ERROR);
+
+  example_x.node->values[0] = 1;
+  example_x.node->values[1] = 2;
+  example_x.node->num_values = 2;
+  skin_draw(sk, 0.016f);
+
+  ASSERT_EQ(item->num_values[SKINFIELD_X], 2);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][0], 2.0f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][1], 4.0f);
+  ASSERT_EQ(item->num_values[SKINFIELD_W], 1);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_W][0], 5.0f);
+  ASSERT_EQ(item->num_values[SKINFIELD_Y], 0);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(item, fixed_tick_interpolation) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "layer");
+  skin_item_t* item = skin_add_item(sk, layer, "item");
+  skin_item_set_field(sk, item, SKINFIELD_X, "example_x");
+  skin_set_fixed_tick(sk, true);
+
+  example_x.node->values[0] = 0;
+  example_x.node->num_values = 1;
+  skin_tick(sk, 1.0f / 60.0f);
+  example_x.node->values[0] = 10;
+  example_x.node->values[1] = 20;
+  example_x.node->num_values = 2;
+  skin_tick(sk, 1.0f / 60.0f);
+
+  // changing the input between ticks does not matter, only ticks evaluate the graph
+  example_x.node->values[0] = 1000;
+
+  skin_draw(sk, 0.25f);
+  ASSERT_EQ(item->num_values[SKINFIELD_X], 2);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][0], 2.5f);
+  // new element snaps to its current value
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][1], 20.0f);
+
+  skin_draw(sk, 1.0f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][0], 10.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(item, layer_update_every) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* fast = skin_add_layer(sk, "fast");
+  skin_layer_t* slow = skin_add_layer(sk, "slow");
+  slow->update_every = 3;
+  skin_item_t* fast_item = skin_add_item(sk, fast, "fast_item");
+  skin_item_t* slow_item = skin_add_item(sk, slow, "slow_item");
+  skin_item_set_field(sk, fast_item, SKINFIELD_X, "example_x");
+  skin_item_set_field(sk, slow_item, SKINFIELD_X, "example_x");
+
+  example_x.node->num_values = 1;
+  for (int frame = 0; frame < 6; frame++) {
+    example_x.node->values[0] = frame;
+    skin_draw(sk, 0.016f);
+    ASSERT_FLOAT_EQ(fast_item->values[SKINFIELD_X][0], (float)frame);
+    // slow layer holds the value from the last frame it ran on
+    ASSERT_FLOAT_EQ(slow_item->values[SKINFIELD_X][0], (float)(frame - frame % 3));
+  }
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(item, layer_update_every_stateful) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* fast = skin_add_layer(sk, "fast");
+  skin_layer_t* slow = skin_add_layer(sk, "slow");
+  slow->update_every = 4;
+  skin_item_t* fast_item = skin_add_item(sk, fast, "fast_item");
+  skin_item_t* slow_item = skin_add_item(sk, slow, "slow_item");
+  skin_item_set_field(sk, fast_item, SKINFIELD_X, "_smooth(example_x, 5)");
+  skin_item_set_field(sk, slow_item, SKINFIELD_X, "_smooth(example_x, 5)");
+  skin_item_set_field(sk, fast_item, SKINFIELD_Y, "_delay(example_x, 3)");
+  skin_item_set_field(sk, slow_item, SKINFIELD_Y, "_delay(example_x, 3)");
+
+  example_x.node->num_values = 1;
+  for (int frame = 0; frame < 13; frame++) {
+    // the target only moves on frames right after the slow layer ran
+    example_x.node->values[0] = 10.0f + 4 * ((frame + 3) / 4);
+    skin_draw(sk, 0.016f);
+    if (frame % 4 == 0) {
+      // the slow layer steps by all the time since it last ran, so it lands on the same values
+      ASSERT(fabsf(slow_item->values[SKINFIELD_X][0] - fast_item->values[SKINFIELD_X][0]) < 1e-4);
+    }
+  }
+  // still well short of the target, so the comparison above means something
+  ASSERT(fast_item->values[SKINFIELD_X][0] < example_x.node->values[0] - 1.0f);
+  // the delay counts clock frames, the frames the slow layer skipped held the value it last saw
+  ASSERT_FLOAT_EQ(fast_item->values[SKINFIELD_Y][0], 22.0f);
+  ASSERT_FLOAT_EQ(slow_item->values[SKINFIELD_Y][0], 18.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(item, layer_max_rate) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "layer");
+  layer->max_rate = 10;
+  skin_item_t* item = skin_add_item(sk, layer, "item");
+  skin_item_set_field(sk, item, SKINFIELD_X, "example_x");
+
+  example_x.node->num_values = 1;
+  example_x.node->values[0] = 1;
+  skin_draw(sk, 0.05f);
+  example_x.node->values[0] = 2;
+  skin_draw(sk, 0.05f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][0], 1.0f);
+  skin_draw(sk, 0.05f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][0], 2.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(item, layer_budget) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* important = skin_add_layer(sk, "important");
+  skin_layer_t* background = skin_add_layer(sk, "background");
+  background->priority = 1;
+  skin_item_t* important_item = skin_add_item(sk, important, "important_item");
+  skin_item_t* background_item = skin_add_item(sk, background, "background_item");
+  skin_item_set_field(sk, important_item, SKINFIELD_X, "example_x");
+  skin_item_set_field(sk, background_item, SKINFIELD_X, "example_x");
+
+  example_x.node->num_values = 1;
+  example_x.node->values[0] = 1;
+  skin_draw(sk, 0.016f);
+
+  // any amount of work blows through this budget, so the background layer gets deferred
+  skin_set_frame_budget(sk, 1e-12f);
+  for (int frame = 0; frame < MAX_DEFERRED_FRAMES; frame++) {
+    example_x.node->values[0] = 2;
+    skin_draw(sk, 0.016f);
+    ASSERT_FLOAT_EQ(important_item->values[SKINFIELD_X][0], 2.0f);
+    ASSERT_FLOAT_EQ(background_item->values[SKINFIELD_X][0], 1.0f);
+  }
+  // but it can't be starved forever
+  skin_draw(sk, 0.016f);
+  ASSERT_FLOAT_EQ(background_item->values[SKINFIELD_X][0], 2.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+TEST(item, vector_field) {
+  skin_t* sk;
+  skin_init(&sk, inputs, 2);
+
+  skin_layer_t* layer = skin_add_layer(sk, "layer");
+  skin_item_t* item = skin_add_item(sk, layer, "item");
+  ASSERT_EQ(skin_item_set_field(sk, item, SKINFIELD_X, "example2_pos * 2"), SKINERR_SUCCESS);
+  ASSERT_EQ(skin_item_set_field(sk, item, SKINFIELD_A, "example2_pos"), SKINERR_EXPRESSION_ERROR);
+
+  float pos[] = {1, 2, 3, 4};
+  memcpy(example2_pos.node->values, pos, sizeof(pos));
+  example2_pos.node->num_values = 4;
+  skin_draw(sk, 0.016f);
+
+  // x and y read straight out of the interleaved vector
+  ASSERT_EQ(item->num_values[SKINFIELD_X], 2);
+  ASSERT_EQ(item->num_values[SKINFIELD_Y], 2);
+  ASSERT_EQ(item->strides[SKINFIELD_X], 2);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_X][item->strides[SKINFIELD_X]], 6.0f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_Y][item->strides[SKINFIELD_Y]], 8.0f);
+
+  // fixed tick mode stores each field on its own
+  skin_set_fixed_tick(sk, true);
+  skin_tick(sk, 0.016f);
+  skin_draw(sk, 1.0f);
+  ASSERT_EQ(item->strides[SKINFIELD_Y], 1);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_Y][0], 4.0f);
+  ASSERT_FLOAT_EQ(item->values[SKINFIELD_Y][1], 8.0f);
+
+  skin_deinit(sk);
+  return 0;
+}
+
+SUITE(sdf);
+
+#define SDF_TEST_SIZE 24
+TEST(sdf, square) {
+  // 8x8 inside square in the middle
+  unsigned char coverage[SDF_TEST_SIZE * SDF_TEST_SIZE] = {0};
+  unsigned char field[SDF_TEST_SIZE * SDF_TEST_SIZE];
+  for (int y = 8; y < 16; y++) {
+    for (int x = 8; x < 16; x++) {
+      coverage[y * SDF_TEST_SIZE + x] = 200;
+    }
+  }
+  sdf_generate(coverage, SDF_TEST_SIZE, SDF_TEST_SIZE, 4.0f, field);
+  // half a pixel either side of the edge
+  ASSERT_EQ(field[12 * SDF_TEST_SIZE + 8], 144);
+  ASSERT_EQ(field[12 * SDF_TEST_SIZE + 7], 112);
+  ASSERT_EQ(field[12 * SDF_TEST_SIZE + 15], 144);
+  ASSERT_EQ(field[12 * SDF_TEST_SIZE + 16], 112);
+  // 3.5 pixels in from the nearest edge
+  ASSERT_EQ(field[12 * SDF_TEST_SIZE + 12], 239);
+  // euclidean out past the corner, sqrt(8) - 0.5 away
+  ASSERT_EQ(field[6 * SDF_TEST_SIZE + 6], 54);
+  // more than spread away saturates
+  ASSERT_EQ(field[0], 0);
+  return 0;
+}
+
+TEST(sdf, uniform) {
+  unsigned char coverage[16] = {0};
+  unsigned char field[16];
+  sdf_generate(coverage, 4, 4, 4.0f, field);
+  for (int i = 0; i < 16; i++) {
+    ASSERT_EQ(field[i], 0);
+  }
+  memset(coverage, 255, sizeof(coverage));
+  sdf_generate(coverage, 4, 4, 4.0f, field);
+  for (int i = 0; i < 16; i++) {
+    ASSERT_EQ(field[i], 255);
+  }
+  return 0;
+}
+
 int main(int argc, char** argv) {
   run_suite(expression_generator);
   run_suite(node_evaluator);
   run_suite(expression_parser);
+  run_suite(animation);
+  run_suite(item);
+  run_suite(particle);
+  run_suite(draw);
+  run_suite(sdf);
 }
\ No newline at end of file